@@ -0,0 +1,53 @@
+#ifndef _BOUNDED_QUEUE_H_
+#define _BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// A blocking FIFO with a fixed capacity, for connecting pipeline stages.
+// push() waits while the queue is full, pop() waits while it is empty.
+// After close(), pop() drains the remaining items and then returns false.
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+  void push(const T &item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock, [this] { return items_.size() < capacity_; });
+    items_.push_back(item);
+    notEmpty_.notify_one();
+  }
+
+  bool pop(T *item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty())
+      return false;
+    *item = items_.front();
+    items_.pop_front();
+    notFull_.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    notEmpty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable notFull_;
+  std::condition_variable notEmpty_;
+  bool closed_ = false;
+};
+
+#endif // #ifndef _BOUNDED_QUEUE_H_
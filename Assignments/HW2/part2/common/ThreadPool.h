@@ -0,0 +1,121 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A persistent fork/join pool.  run() executes a job on numThreads
+// threads, using the calling thread as thread 0, and returns once every
+// thread has finished.  Worker threads are created the first time they
+// are needed and then parked on a condition variable between jobs, so
+// repeated runs (e.g. timing trials) do not pay thread creation cost.
+class ThreadPool
+{
+public:
+  typedef std::function<void(int threadId, int numThreads)> Job;
+
+  ThreadPool() {}
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (std::thread &worker : workers_)
+      worker.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  //////////
+  // Process-wide pool shared by all parallel renderers.
+  static ThreadPool &shared()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  //////////
+  // Number of threads (including the caller) the pool can run without
+  // spawning more workers.
+  int size() const
+  {
+    return static_cast<int>(workers_.size()) + 1;
+  }
+
+  //////////
+  // Run job(threadId, numThreads) for threadId in [0, numThreads) and
+  // wait for all of them.  Not reentrant: job must not call run().
+  void run(int numThreads, const Job &job)
+  {
+    if (numThreads <= 1)
+    {
+      job(0, 1);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (static_cast<int>(workers_.size()) < numThreads - 1)
+      {
+        int threadId = static_cast<int>(workers_.size()) + 1;
+        // New workers start from the current generation so they pick
+        // up the job published below.
+        workers_.emplace_back(&ThreadPool::workerLoop, this, threadId, generation_);
+      }
+      job_ = &job;
+      jobThreads_ = numThreads;
+      pending_ = numThreads - 1;
+      generation_++;
+    }
+    start_.notify_all();
+
+    job(0, numThreads);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+    job_ = nullptr;
+  }
+
+private:
+  void workerLoop(int threadId, unsigned long long seen)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+      start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_)
+        return;
+      seen = generation_;
+      if (threadId >= jobThreads_)
+        continue;
+
+      const Job *job = job_;
+      int numThreads = jobThreads_;
+      lock.unlock();
+      (*job)(threadId, numThreads);
+      lock.lock();
+
+      if (--pending_ == 0)
+        done_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const Job *job_ = nullptr;
+  int jobThreads_ = 0;
+  int pending_ = 0;
+  unsigned long long generation_ = 0;
+  bool stop_ = false;
+};
+
+#endif // #ifndef _THREAD_POOL_H_
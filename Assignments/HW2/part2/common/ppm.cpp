@@ -1,35 +1,308 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
 #include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Rows per band when converting or compressing an image in parallel.
+static constexpr int BAND_ROWS = 64;
+
+//
+// Tone mapping.
+//
+// Clamp the iteration count for a pixel, then scale the value to 0-1
+// range.  Raise resulting value to a power (<1) to increase brightness
+// of low iteration count pixels. a.k.a. Make things look cooler.
+//
+// The mapping only depends on the clamped count, so it is tabulated
+// once per image instead of calling pow() per pixel.
+static std::vector<unsigned char> toneMap(int maxIterations)
+{
+    std::vector<unsigned char> table(std::max(maxIterations, 0) + 1);
+    for (int count = 0; count <= maxIterations; ++count)
+    {
+        float mapped = pow(std::min(static_cast<float>(maxIterations),
+                                    static_cast<float>(count)) /
+                               256.f,
+                           .5f);
+
+        // convert back into 0-255 range, 8-bit channels
+        table[count] = static_cast<unsigned char>(255.f * mapped);
+    }
+    return table;
+}
+
+static inline unsigned char mapPixel(const std::vector<unsigned char> &table, int count)
+{
+    return table[std::min(std::max(count, 0), static_cast<int>(table.size()) - 1)];
+}
+
+static void writeAt(int fd, const void *buffer, size_t size, off_t offset, const char *filename)
+{
+    const char *bytes = static_cast<const char *>(buffer);
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0)
+        {
+            perror(filename);
+            exit(1);
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+static int imageThreads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+//
+// Streaming PPM output.
+//
+// A P6 file has a fixed-size header followed by fixed-size rows, so
+// every row has a known file offset.  Threads can therefore color-map
+// and write their own rows as soon as they are computed, in any order,
+// overlapping the image conversion and I/O with the rendering itself.
+//
+
+typedef struct PPMStream
+{
+    int fd;
+    int width, height;
+    off_t headerBytes;
+    std::vector<unsigned char> table;
+    char *filename;
+} PPMStream;
+
+PPMStream *openPPMStream(const char *filename, int width, int height, int maxIterations)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror(filename);
+        exit(1);
+    }
+
+    char header[64];
+    int headerBytes = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+
+    PPMStream *stream = new PPMStream;
+    stream->fd = fd;
+    stream->width = width;
+    stream->height = height;
+    stream->headerBytes = headerBytes;
+    stream->table = toneMap(maxIterations);
+    stream->filename = strdup(filename);
+
+    writeAt(fd, header, headerBytes, 0, filename);
+    // Size the file up front so rows can land in any order.
+    if (ftruncate(fd, headerBytes + 3 * static_cast<off_t>(width) * height) != 0)
+    {
+        perror(filename);
+        exit(1);
+    }
+    return stream;
+}
+
+// Color-map and write rows [startRow, startRow + numRows) of data, a
+// full width x height image.  Safe to call from several threads at
+// once for disjoint rows.
+void writePPMRows(PPMStream *stream, const int *data, int startRow, int numRows)
+{
+    int width = stream->width;
+    std::vector<unsigned char> rgb(3 * static_cast<size_t>(width) * numRows);
+    const int *src = data + static_cast<size_t>(startRow) * width;
+    for (size_t i = 0; i < static_cast<size_t>(width) * numRows; ++i)
+    {
+        unsigned char result = mapPixel(stream->table, src[i]);
+        rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = result;
+    }
+
+    off_t offset = stream->headerBytes + 3 * static_cast<off_t>(width) * startRow;
+    writeAt(stream->fd, rgb.data(), rgb.size(), offset, stream->filename);
+}
+
+void closePPMStream(PPMStream *stream)
+{
+    close(stream->fd);
+    printf("Wrote image file %s\n", stream->filename);
+    free(stream->filename);
+    delete stream;
+}
 
 void writePPMImage(int *data, int width, int height, const char *filename, int maxIterations)
+{
+    PPMStream *stream = openPPMStream(filename, width, height, maxIterations);
+
+    int numBands = (height + BAND_ROWS - 1) / BAND_ROWS;
+    ThreadPool::shared().run(imageThreads(), [&](int threadId, int numThreads) {
+        for (int band = threadId; band < numBands; band += numThreads)
+        {
+            int startRow = band * BAND_ROWS;
+            writePPMRows(stream, data, startRow, std::min(BAND_ROWS, height - startRow));
+        }
+    });
+
+    closePPMStream(stream);
+}
+
+//
+// Frame output for animations: the tone mapping and the write are
+// separate steps so they can run in different pipeline stages.
+//
+
+// Map iteration counts to the 8-bit gray level writePPMImage() emits.
+void toneMapImage(const int *data, int numPixels, int maxIterations, unsigned char *gray)
+{
+    std::vector<unsigned char> table = toneMap(maxIterations);
+    for (int i = 0; i < numPixels; ++i)
+        gray[i] = mapPixel(table, data[i]);
+}
+
+// Write gray levels from toneMapImage() as a P6 image (R = G = B).
+void writeGrayPPM(const unsigned char *gray, int width, int height, const char *filename)
 {
     FILE *fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        perror(filename);
+        exit(1);
+    }
+
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> rgb(3 * static_cast<size_t>(width));
+    for (int j = 0; j < height; ++j)
+    {
+        const unsigned char *src = gray + static_cast<size_t>(j) * width;
+        for (int i = 0; i < width; ++i)
+            rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = src[i];
+        fwrite(rgb.data(), 1, rgb.size(), fp);
+    }
+    fclose(fp);
+}
 
-    // write ppm header
-    fprintf(fp, "P6\n");
-    fprintf(fp, "%d %d\n", width, height);
-    fprintf(fp, "255\n");
+//
+// Compressed PNG output.
+//
+// The image is written as 8-bit grayscale (every PPM pixel is gray
+// anyway).  Bands of rows are deflated independently in parallel:
+// every band but the last ends with a sync flush, so the raw deflate
+// outputs concatenate into one valid stream, and the per-band Adler-32
+// checksums are merged with adler32_combine().  Bands are then written
+// in order, one IDAT chunk each.
+//
 
-    for (int i = 0; i < width * height; ++i)
+static void putBigEndian(unsigned char *out, unsigned int value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void writeChunk(FILE *fp, const char *type, const unsigned char *data, size_t size)
+{
+    unsigned char word[4];
+    putBigEndian(word, static_cast<unsigned int>(size));
+    fwrite(word, 1, 4, fp);
+    fwrite(type, 1, 4, fp);
+    if (size)
+        fwrite(data, 1, size, fp);
+
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef *>(type), 4);
+    if (size)
+        crc = crc32(crc, data, static_cast<uInt>(size));
+    putBigEndian(word, static_cast<unsigned int>(crc));
+    fwrite(word, 1, 4, fp);
+}
+
+void writePNGImage(int *data, int width, int height, const char *filename, int maxIterations)
+{
+    std::vector<unsigned char> table = toneMap(maxIterations);
+    int numBands = (height + BAND_ROWS - 1) / BAND_ROWS;
+    std::vector<std::vector<unsigned char>> compressed(numBands);
+    std::vector<uLong> adler(numBands);
+    size_t rowBytes = static_cast<size_t>(width) + 1; // filter byte + pixels
+
+    ThreadPool::shared().run(imageThreads(), [&](int threadId, int numThreads) {
+        std::vector<unsigned char> raw;
+        for (int band = threadId; band < numBands; band += numThreads)
+        {
+            int startRow = band * BAND_ROWS;
+            int numRows = std::min(BAND_ROWS, height - startRow);
+
+            raw.resize(rowBytes * numRows);
+            for (int j = 0; j < numRows; ++j)
+            {
+                unsigned char *row = raw.data() + j * rowBytes;
+                const int *src = data + static_cast<size_t>(startRow + j) * width;
+                row[0] = 0; // no filter
+                for (int i = 0; i < width; ++i)
+                    row[i + 1] = mapPixel(table, src[i]);
+            }
+            adler[band] = adler32(adler32(0L, Z_NULL, 0), raw.data(), static_cast<uInt>(raw.size()));
+
+            z_stream zs = {};
+            deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            std::vector<unsigned char> &out = compressed[band];
+            out.resize(deflateBound(&zs, raw.size()) + 16);
+            zs.next_in = raw.data();
+            zs.avail_in = static_cast<uInt>(raw.size());
+            zs.next_out = out.data();
+            zs.avail_out = static_cast<uInt>(out.size());
+            deflate(&zs, band == numBands - 1 ? Z_FINISH : Z_SYNC_FLUSH);
+            out.resize(zs.total_out);
+            deflateEnd(&zs);
+        }
+    });
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp)
     {
+        perror(filename);
+        exit(1);
+    }
 
-        // Clamp iteration count for this pixel, then scale the value
-        // to 0-1 range.  Raise resulting value to a power (<1) to
-        // increase brightness of low iteration count
-        // pixels. a.k.a. Make things look cooler.
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(signature, 1, 8, fp);
 
-        float mapped = pow(std::min(static_cast<float>(maxIterations),
-                                    static_cast<float>(data[i])) /
-                               256.f,
-                           .5f);
+    unsigned char ihdr[13];
+    putBigEndian(ihdr, width);
+    putBigEndian(ihdr + 4, height);
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 0;  // grayscale
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filtering
+    ihdr[12] = 0; // no interlace
+    writeChunk(fp, "IHDR", ihdr, sizeof(ihdr));
 
-        // convert back into 0-255 range, 8-bit channels
-        unsigned char result = static_cast<unsigned char>(255.f * mapped);
-        for (int j = 0; j < 3; ++j)
-            fputc(result, fp);
+    uLong checksum = adler[0];
+    for (int band = 1; band < numBands; ++band)
+    {
+        int numRows = std::min(BAND_ROWS, height - band * BAND_ROWS);
+        checksum = adler32_combine(checksum, adler[band], static_cast<z_off_t>(rowBytes * numRows));
     }
+
+    // zlib header (deflate, 32K window, fastest), bands, then checksum.
+    static const unsigned char zlibHeader[2] = {0x78, 0x01};
+    writeChunk(fp, "IDAT", zlibHeader, 2);
+    for (int band = 0; band < numBands; ++band)
+        writeChunk(fp, "IDAT", compressed[band].data(), compressed[band].size());
+    unsigned char trailer[4];
+    putBigEndian(trailer, static_cast<unsigned int>(checksum));
+    writeChunk(fp, "IDAT", trailer, 4);
+    writeChunk(fp, "IEND", NULL, 0);
+
     fclose(fp);
     printf("Wrote image file %s\n", filename);
 }
@@ -3,8 +3,12 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
+#include <vector>
 
 #include "CycleTimer.h"
+#include "mandelbrotDeep.h"
+#include "mandelbrotThread.h"
 
 extern void mandelbrotSerial(
     float x0, float y0, float x1, float y1,
@@ -20,12 +24,90 @@ extern void mandelbrotThread(
     int maxIterations,
     int output[]);
 
+extern void mandelbrotMarianiSilver(
+    int numThreads,
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int maxIterations, int output[],
+    long long *computedPixels);
+
 extern void writePPMImage(
     int* data,
     int width, int height,
     const char *filename,
     int maxIterations);
 
+extern void writePNGImage(
+    int* data,
+    int width, int height,
+    const char *filename,
+    int maxIterations);
+
+extern int mandelbrotAnimation(
+    int numThreads,
+    const char *keyframeFile, int numFrames, const char *outputDir,
+    int width, int height, int maxIterations);
+
+typedef struct PPMStream PPMStream;
+extern PPMStream* openPPMStream(const char *filename, int width, int height, int maxIterations);
+extern void writePPMRows(PPMStream* stream, const int* data, int startRow, int numRows);
+extern void closePPMStream(PPMStream* stream);
+
+// How rendered images are written out.
+enum OutputFormat {
+    OUTPUT_PPM,     // binary PPM after rendering
+    OUTPUT_PNG,     // compressed grayscale PNG after rendering
+    OUTPUT_STREAM,  // threaded image streamed to PPM while rendering
+};
+
+static OutputFormat outputFormat = OUTPUT_PPM;
+
+// Write data to <stem>.ppm or <stem>.png according to outputFormat.
+void writeImage(int* data, int width, int height, const char* stem, int maxIterations) {
+    char filename[256];
+    if (outputFormat == OUTPUT_PNG) {
+        snprintf(filename, sizeof(filename), "%s.png", stem);
+        writePNGImage(data, width, height, filename, maxIterations);
+    } else {
+        snprintf(filename, sizeof(filename), "%s.ppm", stem);
+        writePPMImage(data, width, height, filename, maxIterations);
+    }
+}
+
+static void streamRows(void* context, const int* output, int startRow, int numRows) {
+    writePPMRows(static_cast<PPMStream*>(context), output, startRow, numRows);
+}
+
+//
+// Render the threaded image once and write it afterwards, then once
+// more with rows streamed to mandelbrot-thread.ppm as worker threads
+// finish them, and compare the two end-to-end times.
+//
+void streamThreadImage(int numThreads,
+                       float x0, float y0, float x1, float y1,
+                       int width, int height, int maxIterations, int output[]) {
+
+    double startTime = CycleTimer::currentSeconds();
+    mandelbrotThread(numThreads, x0, y0, x1, y1, width, height, maxIterations, output);
+    double renderTime = CycleTimer::currentSeconds();
+    writePPMImage(output, width, height, "mandelbrot-thread.ppm", maxIterations);
+    double endTime = CycleTimer::currentSeconds();
+
+    printf("[render then write]:\t\t[%.3f] ms\t(render %.3f ms + write %.3f ms)\n",
+           (endTime - startTime) * 1000, (renderTime - startTime) * 1000,
+           (endTime - renderTime) * 1000);
+
+    startTime = CycleTimer::currentSeconds();
+    PPMStream* stream = openPPMStream("mandelbrot-thread.ppm", width, height, maxIterations);
+    setThreadRowSink(streamRows, stream);
+    mandelbrotThread(numThreads, x0, y0, x1, y1, width, height, maxIterations, output);
+    setThreadRowSink(NULL, NULL);
+    closePPMStream(stream);
+    endTime = CycleTimer::currentSeconds();
+
+    printf("[streamed render+write]:\t[%.3f] ms\n", (endTime - startTime) * 1000);
+}
+
 void
 scaleAndShift(float& x0, float& x1, float& y0, float& y1,
               float scale,
@@ -48,6 +130,19 @@ void usage(const char* progname) {
     printf("Program Options:\n");
     printf("  -t  --threads <N>  Use N threads (Default = 2)\n");
     printf("  -v  --view <INT>   Use specified view settings (Default = 1)\n");
+    printf("  -s  --schedule <S> Row schedule: static or dynamic (Default = static)\n");
+    printf("  -g  --grain <N>    Rows per scheduled block (Default = 1)\n");
+    printf("  -i  --iterations <N> Maximum iterations per pixel (Default = 256)\n");
+    printf("  -k  --kernel <K>   Thread kernel: scalar, simd or interior (Default = scalar)\n");
+    printf("  -m  --mariani      Also run the Mariani-Silver tile renderer\n");
+    printf("  -d  --deep <X,Y,R> Render only a deep-zoom view centered on X,Y with half-width R\n");
+    printf("  -T  --tier <T>     Deep-zoom arithmetic: auto, float, double, dd or perturb (Default = auto)\n");
+    printf("  -c  --cache <N>    Render only an N-frame pan/deepen sequence, uncached then through the tile cache\n");
+    printf("  -o  --output <F>   Image output: ppm, png or stream (Default = ppm)\n");
+    printf("  -a  --animate <F>  Render only an animation along the keyframes in F (lines of X Y R) into frames/\n");
+    printf("  -F  --frames <N>   Number of animation frames (Default = 100)\n");
+    printf("  -S  --scaling      Also sweep thread counts up to the hardware thread count\n");
+    printf("  -j  --trace <F>    Write a Chrome trace JSON timeline of one threaded run to F\n");
     printf("  -?  --help         This message\n");
 }
 
@@ -68,12 +163,133 @@ bool verifyResult (int *gold, int *result, int width, int height) {
     return 1;
 }
 
+//
+// Deep-zoom mode: render the view "X,Y,R" with the precision-tiered
+// engine and write it to mandelbrot-deep.ppm.  X and Y stay strings
+// so they can carry more digits than a double.
+//
+int runDeepView(char* view, DeepTier tier, int numThreads,
+                int width, int height, int maxIterations) {
+
+    char* centerX = strtok(view, ",");
+    char* centerY = strtok(NULL, ",");
+    char* radius = strtok(NULL, ",");
+    if (!centerX || !centerY || !radius || atof(radius) <= 0) {
+        fprintf(stderr, "Invalid deep view, expected X,Y,R\n");
+        return 1;
+    }
+    double halfWidth = atof(radius);
+
+    int* output = new int[width*height];
+    double minDeep = 1e30;
+    DeepTier used = tier;
+    for (int i = 0; i < 3; ++i) {
+        double startTime = CycleTimer::currentSeconds();
+        used = mandelbrotDeep(numThreads, centerX, centerY, halfWidth,
+                              width, height, maxIterations, output, tier);
+        double endTime = CycleTimer::currentSeconds();
+        minDeep = std::min(minDeep, endTime - startTime);
+    }
+
+    printf("[mandelbrot deep]:\t\t[%.3f] ms\n", minDeep * 1000);
+    printf("\t\t\t\t(%s tier, pixel size %.3g, %d threads)\n",
+           deepTierName(used), 2.0 * halfWidth / width, numThreads);
+    writeImage(output, width, height, "mandelbrot-deep", maxIterations);
+
+    delete[] output;
+    return 0;
+}
+
+//
+// Tile cache mode: simulate interactive use with frames that each pan
+// the view by (24, 16) pixels, then a final frame that returns to the
+// first view and quadruples maxIterations.  Every frame is rendered
+// three times: with the plain threaded path for timing, through the
+// cache with all tiles flushed (a fresh render on the cache's pixel
+// lattice), and through the cache as an interactive session would.
+// The last two must be identical, and the run fails otherwise.
+//
+int runCacheDemo(int frames, int numThreads,
+                 float x0, float y0, float x1, float y1,
+                 int width, int height, int maxIterations) {
+
+    const int panX = 24, panY = 16;
+    float dx = (x1 - x0) / width;
+    float dy = (y1 - y0) / height;
+
+    std::vector<std::vector<int>> reference(frames, std::vector<int>(width * height));
+    std::vector<double> uncachedTime(frames);
+    int* output = new int[width*height];
+    int failedFrames = 0;
+
+    for (int pass = 0; pass < 3; ++pass) {
+        // Start every cached pass from an empty cache, so frame 0
+        // anchors the same lattice each time.
+        setTileCache(0);
+        if (pass > 0)
+            setTileCache(4096);
+        for (int f = 0; f < frames; ++f) {
+            bool deepen = f == frames - 1;
+            int step = deepen ? 0 : f;
+            float shiftX = step * panX * dx;
+            float shiftY = step * panY * dy;
+            int iterations = deepen ? 4 * maxIterations : maxIterations;
+            int* target = pass == 1 ? reference[f].data() : output;
+
+            if (pass == 1)
+                flushTileCache();
+            resetTileCacheStats();
+            double startTime = CycleTimer::currentSeconds();
+            mandelbrotThread(numThreads, x0 + shiftX, y0 + shiftY, x1 + shiftX, y1 + shiftY,
+                             width, height, iterations, target);
+            double endTime = CycleTimer::currentSeconds();
+
+            if (pass == 0)
+                uncachedTime[f] = endTime - startTime;
+            if (pass < 2)
+                continue;
+
+            long long reused, resumed, computed;
+            getTileCacheStats(&reused, &resumed, &computed);
+            int mismatches = 0;
+            for (int i = 0; i < width * height; ++i)
+                mismatches += output[i] != reference[f][i];
+            failedFrames += mismatches != 0;
+            printf("[frame %2d %-6s %4d its]:\t[%.3f] ms uncached\t[%.3f] ms cached"
+                   "\t(%lld reused, %lld resumed, %lld new tiles, %d px differ)\n",
+                   f, deepen ? "deepen" : "pan", iterations, uncachedTime[f] * 1000,
+                   (endTime - startTime) * 1000, reused, resumed, computed, mismatches);
+        }
+    }
+    setTileCache(0);
+
+    writeImage(output, width, height, "mandelbrot-cache", 4 * maxIterations);
+    delete[] output;
+
+    if (failedFrames) {
+        fprintf(stderr, "Tile cache: %d frame(s) differ from a fresh render\n", failedFrames);
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
 
     const unsigned int width = 1600;
     const unsigned int height = 1200;
-    const int maxIterations = 256;
+    int maxIterations = 256;
     int numThreads = 2;
+    ScheduleMode schedule = SCHEDULE_STATIC;
+    int grainRows = 1;
+    MandelKernel kernel = KERNEL_SCALAR;
+    bool scaling = false;
+    bool mariani = false;
+    char* deepView = NULL;
+    DeepTier deepTier = TIER_AUTO;
+    int cacheFrames = 0;
+    const char* keyframeFile = NULL;
+    int animationFrames = 100;
+    const char* traceFile = NULL;
 
     float x0 = -2;
     float x1 = 1;
@@ -85,16 +301,33 @@ int main(int argc, char** argv) {
     static struct option long_options[] = {
         {"threads", 1, 0, 't'},
         {"view", 1, 0, 'v'},
+        {"schedule", 1, 0, 's'},
+        {"grain", 1, 0, 'g'},
+        {"iterations", 1, 0, 'i'},
+        {"kernel", 1, 0, 'k'},
+        {"mariani", 0, 0, 'm'},
+        {"deep", 1, 0, 'd'},
+        {"tier", 1, 0, 'T'},
+        {"cache", 1, 0, 'c'},
+        {"output", 1, 0, 'o'},
+        {"animate", 1, 0, 'a'},
+        {"frames", 1, 0, 'F'},
+        {"scaling", 0, 0, 'S'},
+        {"trace", 1, 0, 'j'},
         {"help", 0, 0, '?'},
         {0 ,0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "t:v:?", long_options, NULL)) != EOF) {
+    while ((opt = getopt_long(argc, argv, "t:v:s:g:i:k:md:T:c:o:a:F:Sj:?", long_options, NULL)) != EOF) {
 
         switch (opt) {
         case 't':
         {
             numThreads = atoi(optarg);
+            if (numThreads < 1) {
+                fprintf(stderr, "Invalid thread count\n");
+                return 1;
+            }
             break;
         }
         case 'v':
@@ -112,6 +345,125 @@ int main(int argc, char** argv) {
             }
             break;
         }
+        case 's':
+        {
+            if (strcmp(optarg, "static") == 0) {
+                schedule = SCHEDULE_STATIC;
+            } else if (strcmp(optarg, "dynamic") == 0) {
+                schedule = SCHEDULE_DYNAMIC;
+            } else {
+                fprintf(stderr, "Invalid schedule '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case 'g':
+        {
+            grainRows = atoi(optarg);
+            if (grainRows < 1) {
+                fprintf(stderr, "Invalid grain size\n");
+                return 1;
+            }
+            break;
+        }
+        case 'i':
+        {
+            maxIterations = atoi(optarg);
+            if (maxIterations < 1) {
+                fprintf(stderr, "Invalid iteration count\n");
+                return 1;
+            }
+            break;
+        }
+        case 'k':
+        {
+            if (strcmp(optarg, "scalar") == 0) {
+                kernel = KERNEL_SCALAR;
+            } else if (strcmp(optarg, "simd") == 0) {
+                kernel = KERNEL_SIMD;
+            } else if (strcmp(optarg, "interior") == 0) {
+                kernel = KERNEL_INTERIOR;
+            } else {
+                fprintf(stderr, "Invalid kernel '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case 'm':
+        {
+            mariani = true;
+            break;
+        }
+        case 'd':
+        {
+            deepView = optarg;
+            break;
+        }
+        case 'T':
+        {
+            if (strcmp(optarg, "auto") == 0) {
+                deepTier = TIER_AUTO;
+            } else if (strcmp(optarg, "float") == 0) {
+                deepTier = TIER_FLOAT;
+            } else if (strcmp(optarg, "double") == 0) {
+                deepTier = TIER_DOUBLE;
+            } else if (strcmp(optarg, "dd") == 0) {
+                deepTier = TIER_DOUBLE_DOUBLE;
+            } else if (strcmp(optarg, "perturb") == 0) {
+                deepTier = TIER_PERTURBATION;
+            } else {
+                fprintf(stderr, "Invalid tier '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case 'c':
+        {
+            cacheFrames = atoi(optarg);
+            if (cacheFrames < 2) {
+                fprintf(stderr, "Invalid frame count, need at least 2\n");
+                return 1;
+            }
+            break;
+        }
+        case 'o':
+        {
+            if (strcmp(optarg, "ppm") == 0) {
+                outputFormat = OUTPUT_PPM;
+            } else if (strcmp(optarg, "png") == 0) {
+                outputFormat = OUTPUT_PNG;
+            } else if (strcmp(optarg, "stream") == 0) {
+                outputFormat = OUTPUT_STREAM;
+            } else {
+                fprintf(stderr, "Invalid output format '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case 'a':
+        {
+            keyframeFile = optarg;
+            break;
+        }
+        case 'F':
+        {
+            animationFrames = atoi(optarg);
+            if (animationFrames < 1) {
+                fprintf(stderr, "Invalid frame count\n");
+                return 1;
+            }
+            break;
+        }
+        case 'S':
+        {
+            scaling = true;
+            break;
+        }
+        case 'j':
+        {
+            traceFile = optarg;
+            break;
+        }
         case '?':
         default:
             usage(argv[0]);
@@ -120,6 +472,21 @@ int main(int argc, char** argv) {
     }
     // end parsing of commandline options
 
+    if (keyframeFile) {
+        setThreadSchedule(schedule, grainRows);
+        setThreadKernel(kernel);
+        return mandelbrotAnimation(numThreads, keyframeFile, animationFrames, "frames",
+                                   width, height, maxIterations);
+    }
+
+    if (cacheFrames) {
+        return runCacheDemo(cacheFrames, numThreads, x0, y0, x1, y1, width, height, maxIterations);
+    }
+
+    if (deepView) {
+        return runDeepView(deepView, deepTier, numThreads, width, height, maxIterations);
+    }
+
 
     int* output_serial = new int[width*height];
     int* output_thread = new int[width*height];
@@ -139,23 +506,67 @@ int main(int argc, char** argv) {
     }
 
     printf("[mandelbrot serial]:\t\t[%.3f] ms\n", minSerial * 1000);
-    writePPMImage(output_serial, width, height, "mandelbrot-serial.ppm", maxIterations);
+    writeImage(output_serial, width, height, "mandelbrot-serial", maxIterations);
 
     //
     // Run the threaded version
     //
 
+    setThreadSchedule(schedule, grainRows);
+    setThreadKernel(kernel);
+
     double minThread = 1e30;
+    ThreadStats* threadStats = new ThreadStats[numThreads];
     for (int i = 0; i < 5; ++i) {
         memset(output_thread, 0, width * height * sizeof(int));
+        resetInteriorStats();
         double startTime = CycleTimer::currentSeconds();
         mandelbrotThread(numThreads, x0, y0, x1, y1, width, height, maxIterations, output_thread);
         double endTime = CycleTimer::currentSeconds();
-        minThread = std::min(minThread, endTime - startTime);
+        if (endTime - startTime < minThread) {
+            minThread = endTime - startTime;
+            for (int t = 0; t < numThreads; ++t)
+                threadStats[t] = getThreadStats(t);
+        }
     }
 
     printf("[mandelbrot thread]:\t\t[%.3f] ms\n", minThread * 1000);
-    writePPMImage(output_thread, width, height, "mandelbrot-thread.ppm", maxIterations);
+    printf("\t\t\t\t(%s schedule, %d-row blocks, %s kernel)\n",
+           schedule == SCHEDULE_DYNAMIC ? "dynamic" : "static", grainRows,
+           kernel == KERNEL_SIMD ? mandelbrotSimdIsa() :
+           kernel == KERNEL_INTERIOR ? "interior" : "scalar");
+    if (kernel == KERNEL_INTERIOR) {
+        long long bulbs, cycles;
+        getInteriorStats(&bulbs, &cycles);
+        printf("\t\t\t\t(short-circuited %lld bulb + %lld cycle = %.1f%% of pixels)\n",
+               bulbs, cycles, 100.0 * (bulbs + cycles) / (width * height));
+    }
+    double maxBusy = 0, sumBusy = 0;
+    for (int t = 0; t < numThreads; ++t) {
+        const ThreadStats& stats = threadStats[t];
+        double busy = stats.endSeconds - stats.startSeconds;
+        printf("\t[thread %2d busy]:\t[%.3f] ms  (%.3f-%.3f ms, %d rows)\n",
+               t, busy * 1000, stats.startSeconds * 1000, stats.endSeconds * 1000,
+               stats.rows);
+        maxBusy = std::max(maxBusy, busy);
+        sumBusy += busy;
+    }
+    if (sumBusy > 0)
+        printf("\t[load imbalance]:\t[%.2f] max/mean busy\n", maxBusy * numThreads / sumBusy);
+    delete[] threadStats;
+
+    if (traceFile) {
+        setThreadTracing(true);
+        mandelbrotThread(numThreads, x0, y0, x1, y1, width, height, maxIterations, output_thread);
+        setThreadTracing(false);
+        if (!writeThreadTrace(traceFile))
+            return 1;
+        printf("Wrote thread timeline %s\n", traceFile);
+    }
+    if (outputFormat == OUTPUT_STREAM)
+        streamThreadImage(numThreads, x0, y0, x1, y1, width, height, maxIterations, output_thread);
+    else
+        writeImage(output_thread, width, height, "mandelbrot-thread", maxIterations);
 
     if (! verifyResult (output_serial, output_thread, width, height)) {
         printf ("Error : Output from threads does not match serial output\n");
@@ -169,6 +580,66 @@ int main(int argc, char** argv) {
     // compute speedup
     printf("\t\t\t\t(%.2fx speedup from %d threads)\n", minSerial/minThread, numThreads);
 
+    //
+    // Optionally run the Mariani-Silver renderer and check it against
+    // the serial image.
+    //
+
+    if (mariani) {
+        double minMariani = 1e30;
+        long long computedPixels = 0;
+        for (int i = 0; i < 5; ++i) {
+            memset(output_thread, 0, width * height * sizeof(int));
+            double startTime = CycleTimer::currentSeconds();
+            mandelbrotMarianiSilver(numThreads, x0, y0, x1, y1, width, height, maxIterations,
+                                    output_thread, &computedPixels);
+            double endTime = CycleTimer::currentSeconds();
+            minMariani = std::min(minMariani, endTime - startTime);
+        }
+
+        printf("[mandelbrot mariani-silver]:\t[%.3f] ms\n", minMariani * 1000);
+        writeImage(output_thread, width, height, "mandelbrot-mariani", maxIterations);
+        if (! verifyResult (output_serial, output_thread, width, height)) {
+            printf ("Error : Output from Mariani-Silver does not match serial output\n");
+
+            delete[] output_serial;
+            delete[] output_thread;
+
+            return 1;
+        }
+        printf("\t\t\t\t(%.2fx speedup from %d threads, %.1f%% of pixels iterated)\n",
+               minSerial / minMariani, numThreads, 100.0 * computedPixels / (width * height));
+    }
+
+    //
+    // Optionally sweep thread counts (powers of two, then the hardware
+    // thread count).  The thread pool is persistent, so after the first
+    // trial at each count no trial pays thread creation cost.
+    //
+
+    if (scaling) {
+        int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<int> counts;
+        for (int t = 1; t < maxThreads; t *= 2)
+            counts.push_back(t);
+        counts.push_back(maxThreads);
+
+        printf("[thread scaling]:\t\t(up to %d hardware threads)\n", maxThreads);
+        for (int t : counts) {
+            double minScaling = 1e30;
+            for (int i = 0; i < 5; ++i) {
+                memset(output_thread, 0, width * height * sizeof(int));
+                double startTime = CycleTimer::currentSeconds();
+                mandelbrotThread(t, x0, y0, x1, y1, width, height, maxIterations, output_thread);
+                double endTime = CycleTimer::currentSeconds();
+                minScaling = std::min(minScaling, endTime - startTime);
+            }
+            bool ok = verifyResult(output_serial, output_thread, width, height);
+            printf("\t[%3d threads]:\t\t[%.3f] ms\t(%.2fx speedup)%s\n",
+                   t, minScaling * 1000, minSerial / minScaling, ok ? "" : "  MISMATCH");
+        }
+    }
+
     delete[] output_serial;
     delete[] output_thread;
 
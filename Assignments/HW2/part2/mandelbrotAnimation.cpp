@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "CycleTimer.h"
+#include "mandelbrotDeep.h"
+
+extern void mandelbrotThread(
+    int numThreads,
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int maxIterations,
+    int output[]);
+
+extern void toneMapImage(const int *data, int numPixels, int maxIterations, unsigned char *gray);
+extern void writeGrayPPM(const unsigned char *gray, int width, int height, const char *filename);
+
+//
+// Animation pipeline.
+//
+// Frames flow through three stages connected by bounded queues:
+//
+//   render   (main thread, rows spread over the thread pool by
+//             mandelbrotThread(), or mandelbrotDeep() once a frame is
+//             too deep for float coordinates)
+//   colorize (COLORIZE_THREADS threads, iteration counts -> gray levels)
+//   write    (WRITE_THREADS threads, one PPM file per frame)
+//
+// While frame n is rendering, frame n-1 can be colorized and frame n-2
+// written.  Buffers circulate through free lists of FRAMES_IN_FLIGHT
+// entries, which bounds memory no matter how many frames are rendered.
+//
+
+static constexpr int FRAMES_IN_FLIGHT = 4;
+static constexpr int COLORIZE_THREADS = 2;
+static constexpr int WRITE_THREADS = 2;
+
+typedef struct
+{
+    double centerX, centerY;
+    double halfWidth;
+} Keyframe;
+
+typedef struct
+{
+    int index;
+    int *counts;
+    unsigned char *gray;
+} Frame;
+
+static bool loadKeyframes(const char *filename, std::vector<Keyframe> *keyframes)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+    {
+        perror(filename);
+        return false;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+        Keyframe key;
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%lf %lf %lf", &key.centerX, &key.centerY, &key.halfWidth) == 3 &&
+            key.halfWidth > 0)
+            keyframes->push_back(key);
+    }
+    fclose(fp);
+
+    if (keyframes->size() < 2)
+    {
+        fprintf(stderr, "Error: %s needs at least two 'centerX centerY halfWidth' lines\n",
+                filename);
+        return false;
+    }
+    return true;
+}
+
+// View of frame f of numFrames: keyframes are spaced evenly in time,
+// the center moves linearly and the zoom geometrically between them.
+static Keyframe interpolate(const std::vector<Keyframe> &keyframes, int f, int numFrames)
+{
+    double t = numFrames > 1 ? static_cast<double>(f) / (numFrames - 1) : 0.0;
+    double position = t * (keyframes.size() - 1);
+    int k = std::min(static_cast<int>(position), static_cast<int>(keyframes.size()) - 2);
+    double u = position - k;
+
+    const Keyframe &a = keyframes[k];
+    const Keyframe &b = keyframes[k + 1];
+    Keyframe view;
+    view.centerX = a.centerX + u * (b.centerX - a.centerX);
+    view.centerY = a.centerY + u * (b.centerY - a.centerY);
+    view.halfWidth = a.halfWidth * pow(b.halfWidth / a.halfWidth, u);
+    return view;
+}
+
+static void renderFrame(int numThreads, const Keyframe &view,
+                        int width, int height, int maxIterations, int output[])
+{
+    double pixel = 2.0 * view.halfWidth / width;
+    double magnitude = std::max(fabs(view.centerX), fabs(view.centerY));
+    if (chooseDeepTier(magnitude, pixel) == TIER_FLOAT)
+    {
+        double halfHeight = 0.5 * pixel * height;
+        mandelbrotThread(numThreads,
+                         view.centerX - view.halfWidth, view.centerY - halfHeight,
+                         view.centerX + view.halfWidth, view.centerY + halfHeight,
+                         width, height, maxIterations, output);
+    }
+    else
+    {
+        char centerX[32], centerY[32];
+        snprintf(centerX, sizeof(centerX), "%.17g", view.centerX);
+        snprintf(centerY, sizeof(centerY), "%.17g", view.centerY);
+        mandelbrotDeep(numThreads, centerX, centerY, view.halfWidth,
+                       width, height, maxIterations, output, TIER_AUTO);
+    }
+}
+
+//
+// MandelbrotAnimation --
+//
+// Render numFrames frames along the keyframe path in keyframeFile into
+// <outputDir>/frame-NNNNN.ppm, then report throughput and how busy each
+// stage was.  Returns 0 on success.
+int mandelbrotAnimation(
+    int numThreads,
+    const char *keyframeFile, int numFrames, const char *outputDir,
+    int width, int height, int maxIterations)
+{
+    std::vector<Keyframe> keyframes;
+    if (!loadKeyframes(keyframeFile, &keyframes))
+        return 1;
+    if (mkdir(outputDir, 0755) != 0 && errno != EEXIST)
+    {
+        perror(outputDir);
+        return 1;
+    }
+
+    int numPixels = width * height;
+    std::vector<std::vector<int>> countBuffers(FRAMES_IN_FLIGHT, std::vector<int>(numPixels));
+    std::vector<std::vector<unsigned char>> grayBuffers(FRAMES_IN_FLIGHT,
+                                                        std::vector<unsigned char>(numPixels));
+
+    BoundedQueue<int *> freeCounts(FRAMES_IN_FLIGHT);
+    BoundedQueue<unsigned char *> freeGray(FRAMES_IN_FLIGHT);
+    BoundedQueue<Frame> rendered(FRAMES_IN_FLIGHT);
+    BoundedQueue<Frame> colorized(FRAMES_IN_FLIGHT);
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        freeCounts.push(countBuffers[i].data());
+        freeGray.push(grayBuffers[i].data());
+    }
+
+    std::vector<double> colorizeBusy(COLORIZE_THREADS, 0.0);
+    std::vector<double> writeBusy(WRITE_THREADS, 0.0);
+
+    double startTime = CycleTimer::currentSeconds();
+
+    std::vector<std::thread> colorizers;
+    for (int t = 0; t < COLORIZE_THREADS; ++t)
+    {
+        colorizers.emplace_back([&, t] {
+            Frame frame;
+            while (rendered.pop(&frame))
+            {
+                freeGray.pop(&frame.gray);
+                double begin = CycleTimer::currentSeconds();
+                toneMapImage(frame.counts, numPixels, maxIterations, frame.gray);
+                colorizeBusy[t] += CycleTimer::currentSeconds() - begin;
+                freeCounts.push(frame.counts);
+                colorized.push(frame);
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < WRITE_THREADS; ++t)
+    {
+        writers.emplace_back([&, t] {
+            Frame frame;
+            char filename[512];
+            while (colorized.pop(&frame))
+            {
+                double begin = CycleTimer::currentSeconds();
+                snprintf(filename, sizeof(filename), "%s/frame-%05d.ppm", outputDir, frame.index);
+                writeGrayPPM(frame.gray, width, height, filename);
+                writeBusy[t] += CycleTimer::currentSeconds() - begin;
+                freeGray.push(frame.gray);
+            }
+        });
+    }
+
+    double renderBusy = 0.0;
+    for (int f = 0; f < numFrames; ++f)
+    {
+        Frame frame = {f, NULL, NULL};
+        freeCounts.pop(&frame.counts);
+        double begin = CycleTimer::currentSeconds();
+        renderFrame(numThreads, interpolate(keyframes, f, numFrames),
+                    width, height, maxIterations, frame.counts);
+        renderBusy += CycleTimer::currentSeconds() - begin;
+        rendered.push(frame);
+    }
+
+    rendered.close();
+    for (std::thread &colorizer : colorizers)
+        colorizer.join();
+    colorized.close();
+    for (std::thread &writer : writers)
+        writer.join();
+
+    double elapsed = CycleTimer::currentSeconds() - startTime;
+    double colorizeTotal = 0.0, writeTotal = 0.0;
+    for (double busy : colorizeBusy)
+        colorizeTotal += busy;
+    for (double busy : writeBusy)
+        writeTotal += busy;
+
+    printf("[mandelbrot animation]:\t\t[%.3f] ms\t(%d frames, %.2f frames/sec)\n",
+           elapsed * 1000, numFrames, numFrames / elapsed);
+    printf("\t[render   x%d pool]:\t[%5.1f%%] busy\n", numThreads, 100.0 * renderBusy / elapsed);
+    printf("\t[colorize x%d]:\t\t[%5.1f%%] busy\n", COLORIZE_THREADS,
+           100.0 * colorizeTotal / (elapsed * COLORIZE_THREADS));
+    printf("\t[write    x%d]:\t\t[%5.1f%%] busy\n", WRITE_THREADS,
+           100.0 * writeTotal / (elapsed * WRITE_THREADS));
+    printf("Wrote %d frames to %s/\n", numFrames, outputDir);
+    return 0;
+}
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "CycleTimer.h"
+#include "ThreadPool.h"
+#include "mandelbrotThread.h"
+
+//
+// Iteration-count tile cache.
+//
+// Pixels live on a lattice: for a given pixel size (dx, dy), the first
+// view rendered at that scale fixes an origin, and lattice pixel
+// (gi, gj) is c = (originX + gi * dx, originY + gj * dy), evaluated
+// with the same float arithmetic as mandelbrotSerial().  Later views at
+// the same scale whose corner lies on the lattice (a pan by a whole
+// number of pixels) map onto it, so their overlap is read back from
+// cached tiles instead of being iterated again.  A cached render is
+// the view snapped onto its lattice: every pixel, cached or not, is
+// evaluated at originX + gi * dx, so a tile reads back exactly what
+// computing it afresh on the same lattice gives.  The first view at a
+// scale anchors the lattice and matches an uncached render; a panned
+// view can differ from an uncached render of its own corner in the
+// last bit of some pixels' c, since x0 + i * dx rounds differently.
+//
+// Each cached pixel keeps its escape state: the iteration count and the
+// value of z at that point.  A pixel whose count reached the tile's
+// maxIterations has not escaped yet, so when a view asks for more
+// iterations it resumes from the stored z instead of starting over,
+// giving exactly the counts a fresh render would.  Views asking for
+// fewer iterations are served by clamping the cached counts.
+//
+
+static constexpr int TILE_SIZE = 64;
+static constexpr int TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+static constexpr int MAX_LATTICES = 256;
+
+typedef struct
+{
+    int id;
+    float originX, originY;
+    float dx, dy;
+} Lattice;
+
+typedef struct
+{
+    int maxIterations;
+    int count[TILE_PIXELS];
+    float z_re[TILE_PIXELS];
+    float z_im[TILE_PIXELS];
+} Tile;
+
+struct TileKey
+{
+    int lattice;
+    int tx, ty;
+
+    bool operator==(const TileKey &other) const
+    {
+        return lattice == other.lattice && tx == other.tx && ty == other.ty;
+    }
+};
+
+struct TileKeyHash
+{
+    size_t operator()(const TileKey &key) const
+    {
+        size_t h = static_cast<size_t>(key.lattice) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<size_t>(static_cast<unsigned>(key.tx)) * 0xC2B2AE3D27D4EB4Full;
+        h ^= static_cast<size_t>(static_cast<unsigned>(key.ty)) * 0x165667B19E3779F9ull;
+        return h;
+    }
+};
+
+typedef struct
+{
+    std::shared_ptr<Tile> tile;
+    std::list<TileKey>::iterator lru;
+} CacheEntry;
+
+// All cache state is guarded by cacheMutex.  Tile contents are only
+// touched by the one thread rendering that tile, and renders do not
+// overlap, so tiles themselves need no locking.
+static std::mutex cacheMutex;
+static int cacheCapacity = 0;
+static int nextLatticeId = 0;
+static std::vector<Lattice> lattices;
+static std::unordered_map<TileKey, CacheEntry, TileKeyHash> cachedTiles;
+static std::list<TileKey> lruOrder; // most recently used first
+
+static std::atomic<long long> tilesReused(0);
+static std::atomic<long long> tilesResumed(0);
+static std::atomic<long long> tilesComputed(0);
+
+static void evictLocked()
+{
+    while (static_cast<int>(cachedTiles.size()) > cacheCapacity)
+    {
+        cachedTiles.erase(lruOrder.back());
+        lruOrder.pop_back();
+    }
+}
+
+void setTileCache(int maxTiles)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cacheCapacity = std::max(0, maxTiles);
+    evictLocked();
+    if (cacheCapacity == 0)
+        lattices.clear();
+}
+
+void flushTileCache()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cachedTiles.clear();
+    lruOrder.clear();
+}
+
+bool tileCacheEnabled()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cacheCapacity > 0;
+}
+
+void resetTileCacheStats()
+{
+    tilesReused = 0;
+    tilesResumed = 0;
+    tilesComputed = 0;
+}
+
+void getTileCacheStats(long long *reused, long long *resumed, long long *computed)
+{
+    *reused = tilesReused.load();
+    *resumed = tilesResumed.load();
+    *computed = tilesComputed.load();
+}
+
+//
+// Find the lattice a view with corner (x0, y0) and pixel size (dx, dy)
+// falls on, creating one anchored at the corner if none matches, and
+// return the lattice coordinates of the view's first pixel.
+static Lattice findLattice(float x0, float y0, float dx, float dy, int *offsetX, int *offsetY)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    for (const Lattice &lattice : lattices)
+    {
+        // Scale must agree to well under a pixel across any image width
+        // we render, and the corner must sit on a lattice point.
+        if (fabs(dx - lattice.dx) > 1e-5 * fabs(lattice.dx) ||
+            fabs(dy - lattice.dy) > 1e-5 * fabs(lattice.dy))
+            continue;
+
+        double kx = (static_cast<double>(x0) - lattice.originX) / lattice.dx;
+        double ky = (static_cast<double>(y0) - lattice.originY) / lattice.dy;
+        if (fabs(kx - nearbyint(kx)) < 1e-2 && fabs(ky - nearbyint(ky)) < 1e-2 &&
+            fabs(kx) < 1e9 && fabs(ky) < 1e9)
+        {
+            *offsetX = static_cast<int>(nearbyint(kx));
+            *offsetY = static_cast<int>(nearbyint(ky));
+            return lattice;
+        }
+    }
+
+    if (static_cast<int>(lattices.size()) == MAX_LATTICES)
+        lattices.erase(lattices.begin());
+    lattices.push_back({nextLatticeId++, x0, y0, dx, dy});
+    *offsetX = 0;
+    *offsetY = 0;
+    return lattices.back();
+}
+
+static std::shared_ptr<Tile> acquireTile(const TileKey &key)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto it = cachedTiles.find(key);
+    if (it != cachedTiles.end())
+    {
+        lruOrder.splice(lruOrder.begin(), lruOrder, it->second.lru);
+        return it->second.tile;
+    }
+
+    // Evicted tiles stay alive through the returned pointer until the
+    // thread rendering them is done.
+    std::shared_ptr<Tile> tile = std::make_shared<Tile>();
+    tile->maxIterations = 0;
+    lruOrder.push_front(key);
+    cachedTiles[key] = {tile, lruOrder.begin()};
+    evictLocked();
+    return tile;
+}
+
+//
+// mandel() from mandelbrotSerial.cpp, continued from iteration start
+// with z = (*zr, *zi), writing back the final z.
+static inline int mandelResume(float c_re, float c_im, float *zr, float *zi, int start, int count)
+{
+    float z_re = *zr, z_im = *zi;
+    int i;
+    for (i = start; i < count; ++i)
+    {
+
+        if (z_re * z_re + z_im * z_im > 4.f)
+            break;
+
+        float new_re = z_re * z_re - z_im * z_im;
+        float new_im = 2.f * z_re * z_im;
+        z_re = c_re + new_re;
+        z_im = c_im + new_im;
+    }
+
+    *zr = z_re;
+    *zi = z_im;
+    return i;
+}
+
+// Bring every pixel of the tile up to maxIterations.
+static void advanceTile(const Lattice &lattice, int tx, int ty, Tile *tile, int maxIterations)
+{
+    bool fresh = tile->maxIterations == 0;
+    int previous = tile->maxIterations;
+
+    for (int j = 0; j < TILE_SIZE; j++)
+    {
+        int gj = ty * TILE_SIZE + j;
+        float y = lattice.originY + gj * lattice.dy;
+        for (int i = 0; i < TILE_SIZE; i++)
+        {
+            int gi = tx * TILE_SIZE + i;
+            float x = lattice.originX + gi * lattice.dx;
+
+            int index = j * TILE_SIZE + i;
+            if (fresh)
+            {
+                tile->z_re[index] = x;
+                tile->z_im[index] = y;
+            }
+            else if (tile->count[index] < previous)
+            {
+                continue; // already escaped
+            }
+            tile->count[index] = mandelResume(x, y, &tile->z_re[index], &tile->z_im[index],
+                                              fresh ? 0 : previous, maxIterations);
+        }
+    }
+
+    tile->maxIterations = maxIterations;
+}
+
+static inline int floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+//
+// MandelbrotCached --
+//
+// Render a view through the tile cache on numThreads threads of the
+// shared pool.  Called by mandelbrotThread() while the cache is
+// enabled; must not be called concurrently with itself.
+void mandelbrotCached(
+    int numThreads,
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int maxIterations, int output[],
+    double busySeconds[])
+{
+    float dx = (x1 - x0) / width;
+    float dy = (y1 - y0) / height;
+
+    int offsetX, offsetY;
+    Lattice lattice = findLattice(x0, y0, dx, dy, &offsetX, &offsetY);
+
+    int tx0 = floorDiv(offsetX, TILE_SIZE);
+    int ty0 = floorDiv(offsetY, TILE_SIZE);
+    int tilesX = floorDiv(offsetX + width - 1, TILE_SIZE) - tx0 + 1;
+    int tilesY = floorDiv(offsetY + height - 1, TILE_SIZE) - ty0 + 1;
+    int numTiles = tilesX * tilesY;
+    std::atomic<int> nextTile(0);
+
+    ThreadPool::shared().run(numThreads, [&](int threadId, int) {
+        double startTime = CycleTimer::currentSeconds();
+        int t;
+        while ((t = nextTile.fetch_add(1, std::memory_order_relaxed)) < numTiles)
+        {
+            TileKey key = {lattice.id, tx0 + t % tilesX, ty0 + t / tilesX};
+            std::shared_ptr<Tile> tile = acquireTile(key);
+
+            if (tile->maxIterations == 0)
+                tilesComputed++;
+            else if (tile->maxIterations < maxIterations)
+                tilesResumed++;
+            else
+                tilesReused++;
+            if (tile->maxIterations < maxIterations)
+                advanceTile(lattice, key.tx, key.ty, tile.get(), maxIterations);
+
+            // Copy the part of the tile inside the view.
+            int gi0 = std::max(key.tx * TILE_SIZE, offsetX);
+            int gi1 = std::min((key.tx + 1) * TILE_SIZE, offsetX + width);
+            int gj0 = std::max(key.ty * TILE_SIZE, offsetY);
+            int gj1 = std::min((key.ty + 1) * TILE_SIZE, offsetY + height);
+            for (int gj = gj0; gj < gj1; gj++)
+            {
+                const int *src = tile->count + (gj - key.ty * TILE_SIZE) * TILE_SIZE - key.tx * TILE_SIZE;
+                int *dst = output + (gj - offsetY) * width - offsetX;
+                for (int gi = gi0; gi < gi1; gi++)
+                    dst[gi] = std::min(src[gi], maxIterations);
+            }
+        }
+        busySeconds[threadId] = CycleTimer::currentSeconds() - startTime;
+    });
+}
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "mandelbrotDeep.h"
+
+//
+// Double-double arithmetic.
+//
+// A value is the unevaluated sum hi + lo with |lo| <= ulp(hi) / 2,
+// giving about 106 bits of mantissa.  The error-free transformations
+// below need IEEE rounding of every operation, which is why this file
+// is built with -ffp-contract=off.
+//
+
+typedef struct
+{
+    double hi, lo;
+} dd;
+
+static inline dd quickTwoSum(double a, double b)
+{
+    double s = a + b;
+    return {s, b - (s - a)};
+}
+
+static inline dd twoSum(double a, double b)
+{
+    double s = a + b;
+    double bb = s - a;
+    return {s, (a - (s - bb)) + (b - bb)};
+}
+
+static inline void split(double a, double *hi, double *lo)
+{
+    double t = 134217729.0 * a; // 2^27 + 1
+    *hi = t - (t - a);
+    *lo = a - *hi;
+}
+
+static inline dd twoProd(double a, double b)
+{
+    double p = a * b;
+    double ah, al, bh, bl;
+    split(a, &ah, &al);
+    split(b, &bh, &bl);
+    return {p, ((ah * bh - p) + ah * bl + al * bh) + al * bl};
+}
+
+static inline dd ddAdd(dd a, dd b)
+{
+    dd s = twoSum(a.hi, b.hi);
+    dd t = twoSum(a.lo, b.lo);
+    s.lo += t.hi;
+    s = quickTwoSum(s.hi, s.lo);
+    s.lo += t.lo;
+    return quickTwoSum(s.hi, s.lo);
+}
+
+static inline dd ddAdd(dd a, double b)
+{
+    dd s = twoSum(a.hi, b);
+    s.lo += a.lo;
+    return quickTwoSum(s.hi, s.lo);
+}
+
+static inline dd ddSub(dd a, dd b)
+{
+    return ddAdd(a, dd{-b.hi, -b.lo});
+}
+
+static inline dd ddMul(dd a, dd b)
+{
+    dd p = twoProd(a.hi, b.hi);
+    p.lo += a.hi * b.lo + a.lo * b.hi;
+    return quickTwoSum(p.hi, p.lo);
+}
+
+static inline dd ddMul(dd a, double b)
+{
+    dd p = twoProd(a.hi, b);
+    p.lo += a.lo * b;
+    return quickTwoSum(p.hi, p.lo);
+}
+
+static inline dd ddDiv(dd a, double b)
+{
+    double q1 = a.hi / b;
+    dd p = twoProd(q1, b);
+    dd r = twoSum(a.hi, -p.hi);
+    r.lo -= p.lo;
+    r.lo += a.lo;
+    double q2 = (r.hi + r.lo) / b;
+    return quickTwoSum(q1, q2);
+}
+
+//
+// Parse a decimal string ("-0.7436438870371587", "1.25e-3") into a
+// double-double, keeping digits beyond double precision.
+static dd parseDD(const char *str)
+{
+    const char *p = str;
+    while (isspace((unsigned char)*p))
+        p++;
+
+    bool negative = false;
+    if (*p == '+' || *p == '-')
+        negative = *p++ == '-';
+
+    dd value = {0.0, 0.0};
+    int exponent = 0;
+    bool seenPoint = false, seenDigit = false;
+    for (; *p; p++)
+    {
+        if (isdigit((unsigned char)*p))
+        {
+            value = ddAdd(ddMul(value, 10.0), (double)(*p - '0'));
+            if (seenPoint)
+                exponent--;
+            seenDigit = true;
+        }
+        else if (*p == '.' && !seenPoint)
+        {
+            seenPoint = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (*p == 'e' || *p == 'E')
+        exponent += atoi(p + 1);
+
+    if (!seenDigit)
+    {
+        fprintf(stderr, "Error: Invalid coordinate '%s'\n", str);
+        exit(1);
+    }
+
+    for (; exponent > 0; exponent--)
+        value = ddMul(value, 10.0);
+    for (; exponent < 0; exponent++)
+        value = ddDiv(value, 10.0);
+
+    return negative ? dd{-value.hi, -value.lo} : value;
+}
+
+//
+// Per-pixel iteration at each tier.  All of them count iterations the
+// same way as mandel() in mandelbrotSerial.cpp.
+//
+
+template <typename T>
+static inline int mandelTier(T c_re, T c_im, int count)
+{
+    T z_re = c_re, z_im = c_im;
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+        if (z_re * z_re + z_im * z_im > T(4))
+            break;
+
+        T new_re = z_re * z_re - z_im * z_im;
+        T new_im = T(2) * z_re * z_im;
+        z_re = c_re + new_re;
+        z_im = c_im + new_im;
+    }
+    return i;
+}
+
+static inline int mandelDD(dd c_re, dd c_im, int count)
+{
+    dd z_re = c_re, z_im = c_im;
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+        dd re2 = ddMul(z_re, z_re);
+        dd im2 = ddMul(z_im, z_im);
+        if (re2.hi + im2.hi > 4.0)
+            break;
+
+        dd new_im = ddMul(ddMul(z_re, z_im), 2.0);
+        z_re = ddAdd(c_re, ddSub(re2, im2));
+        z_im = ddAdd(c_im, new_im);
+    }
+    return i;
+}
+
+//
+// Perturbation.
+//
+// With the reference orbit Z_{n+1} = Z_n^2 + C (Z_0 = 0) and a pixel
+// c = C + dc, the pixel orbit z_n = Z_n + d_n obeys
+//
+//     d_{n+1} = (2 Z_n + d_n) d_n + dc,
+//
+// which only involves small quantities and is accurate in double even
+// when C itself needs more digits.  When the pixel orbit gets closer to
+// zero than its delta (|z| < |d|), or runs past the end of the reference
+// orbit, the delta is rebased onto the start of the reference
+// (d = z, n = 0), which avoids the usual perturbation glitches.
+//
+
+typedef struct
+{
+    std::vector<double> re, im;
+} ReferenceOrbit;
+
+static void computeReference(dd c_re, dd c_im, int maxIterations, ReferenceOrbit *orbit)
+{
+    dd z_re = {0.0, 0.0}, z_im = {0.0, 0.0};
+    orbit->re.assign(1, 0.0);
+    orbit->im.assign(1, 0.0);
+    for (int n = 0; n < maxIterations; n++)
+    {
+        dd new_im = ddMul(ddMul(z_re, z_im), 2.0);
+        z_re = ddAdd(c_re, ddSub(ddMul(z_re, z_re), ddMul(z_im, z_im)));
+        z_im = ddAdd(c_im, new_im);
+        orbit->re.push_back(z_re.hi);
+        orbit->im.push_back(z_im.hi);
+        if (z_re.hi * z_re.hi + z_im.hi * z_im.hi > 4.0)
+            break;
+    }
+}
+
+static inline int mandelPerturbed(const ReferenceOrbit &orbit, double dc_re, double dc_im, int count)
+{
+    const double *Z_re = orbit.re.data();
+    const double *Z_im = orbit.im.data();
+    int last = static_cast<int>(orbit.re.size()) - 1;
+
+    double d_re = 0.0, d_im = 0.0;
+    double z_re = 0.0, z_im = 0.0;
+    int i = 0;
+    while (i < count)
+    {
+        // Iterate against the reference until the orbit escapes or a
+        // rebase is due.  Rebasing outside this loop keeps it a branch:
+        // as a select it would put the magnitude test on the d_n
+        // dependency chain and run several times slower.
+        for (int m = 0; i < count; ++i)
+        {
+            double t_re = 2.0 * Z_re[m] + d_re;
+            double t_im = 2.0 * Z_im[m] + d_im;
+            double new_re = t_re * d_re - t_im * d_im + dc_re;
+            double new_im = t_re * d_im + t_im * d_re + dc_im;
+            d_re = new_re;
+            d_im = new_im;
+            m++;
+
+            z_re = Z_re[m] + d_re;
+            z_im = Z_im[m] + d_im;
+            double mag = z_re * z_re + z_im * z_im;
+            if (mag > 4.0)
+                return i;
+
+            if (m == last || mag < d_re * d_re + d_im * d_im)
+            {
+                ++i;
+                break;
+            }
+        }
+        d_re = z_re;
+        d_im = z_im;
+    }
+    return i;
+}
+
+const char *deepTierName(DeepTier tier)
+{
+    switch (tier)
+    {
+    case TIER_FLOAT:
+        return "float";
+    case TIER_DOUBLE:
+        return "double";
+    case TIER_DOUBLE_DOUBLE:
+        return "double-double";
+    case TIER_PERTURBATION:
+        return "perturbation";
+    default:
+        return "auto";
+    }
+}
+
+//
+// Each tier needs the pixel spacing to stay well above the rounding
+// step of the center coordinate: float keeps ~8 of its 24 mantissa bits
+// for the spacing, double ~8 of 53.  Per-pixel double-double costs
+// several times more than a perturbed double orbit, so it only covers
+// the first few bits past double; deeper views use perturbation, whose
+// double-double reference limits it to about 2^-100.
+DeepTier chooseDeepTier(double centerMagnitude, double pixelSize)
+{
+    double relative = pixelSize / std::max(1.0, centerMagnitude);
+    if (relative >= ldexp(1.0, -16))
+        return TIER_FLOAT;
+    if (relative >= ldexp(1.0, -44))
+        return TIER_DOUBLE;
+    if (relative >= ldexp(1.0, -50))
+        return TIER_DOUBLE_DOUBLE;
+    return TIER_PERTURBATION;
+}
+
+DeepTier mandelbrotDeep(
+    int numThreads,
+    const char *centerX, const char *centerY, double halfWidth,
+    int width, int height,
+    int maxIterations, int output[],
+    DeepTier tier)
+{
+    if (numThreads < 1)
+    {
+        fprintf(stderr, "Error: Need at least one thread\n");
+        exit(1);
+    }
+
+    dd cx = parseDD(centerX);
+    dd cy = parseDD(centerY);
+    double pixel = 2.0 * halfWidth / width;
+
+    if (tier == TIER_AUTO)
+        tier = chooseDeepTier(std::max(fabs(cx.hi), fabs(cy.hi)), pixel);
+    if (pixel / std::max(1.0, std::max(fabs(cx.hi), fabs(cy.hi))) < ldexp(1.0, -100))
+        fprintf(stderr, "Warning: view is deeper than double-double can resolve\n");
+
+    ReferenceOrbit orbit;
+    if (tier == TIER_PERTURBATION)
+        computeReference(cx, cy, maxIterations, &orbit);
+
+    std::atomic<int> nextRow(0);
+    ThreadPool::shared().run(numThreads, [&](int, int) {
+        int j;
+        while ((j = nextRow.fetch_add(1, std::memory_order_relaxed)) < height)
+        {
+            double dy = (j - 0.5 * height) * pixel;
+            int *row = output + j * width;
+            for (int i = 0; i < width; i++)
+            {
+                double dx = (i - 0.5 * width) * pixel;
+                switch (tier)
+                {
+                case TIER_FLOAT:
+                    row[i] = mandelTier<float>((float)(cx.hi + dx), (float)(cy.hi + dy), maxIterations);
+                    break;
+                case TIER_DOUBLE:
+                    row[i] = mandelTier<double>(cx.hi + dx, cy.hi + dy, maxIterations);
+                    break;
+                case TIER_DOUBLE_DOUBLE:
+                    row[i] = mandelDD(ddAdd(cx, dx), ddAdd(cy, dy), maxIterations);
+                    break;
+                default:
+                    row[i] = mandelPerturbed(orbit, dx, dy, maxIterations);
+                    break;
+                }
+            }
+        }
+    });
+
+    return tier;
+}
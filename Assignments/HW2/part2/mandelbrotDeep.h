@@ -0,0 +1,38 @@
+#ifndef _MANDELBROT_DEEP_H_
+#define _MANDELBROT_DEEP_H_
+
+// Arithmetic used by mandelbrotDeep(), from cheapest to most precise.
+//
+// * TIER_FLOAT / TIER_DOUBLE iterate every pixel in hardware floats.
+// * TIER_DOUBLE_DOUBLE iterates every pixel in double-double (~106-bit)
+//   arithmetic.
+// * TIER_PERTURBATION iterates one double-double reference orbit at the
+//   view center and only double-precision deltas per pixel.
+enum DeepTier
+{
+    TIER_AUTO = -1,
+    TIER_FLOAT = 0,
+    TIER_DOUBLE = 1,
+    TIER_DOUBLE_DOUBLE = 2,
+    TIER_PERTURBATION = 3,
+};
+
+const char *deepTierName(DeepTier tier);
+
+// Cheapest tier that still resolves pixels of size pixelSize around a
+// center of the given magnitude.
+DeepTier chooseDeepTier(double centerMagnitude, double pixelSize);
+
+// Render a width x height view centered on (centerX, centerY), given as
+// decimal strings so they can carry more digits than a double, with
+// square pixels spanning 2 * halfWidth horizontally.  Rows are spread
+// over numThreads threads of the shared pool.  Returns the tier used;
+// pass TIER_AUTO to pick it from the view size.
+DeepTier mandelbrotDeep(
+    int numThreads,
+    const char *centerX, const char *centerY, double halfWidth,
+    int width, int height,
+    int maxIterations, int output[],
+    DeepTier tier);
+
+#endif // #ifndef _MANDELBROT_DEEP_H_
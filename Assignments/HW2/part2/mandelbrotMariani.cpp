@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+
+#include "ThreadPool.h"
+
+extern int mandelbrotPixel(
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int i, int j,
+    int maxIterations);
+
+//
+// Mariani-Silver rendering.
+//
+// The image is cut into TILE_SIZE x TILE_SIZE tiles that threads take
+// from a shared counter.  Within a tile, a rectangle's border is
+// computed first; if every border pixel has the same iteration count
+// the interior is filled with that count, otherwise the rectangle is
+// split in two along its longer side and each half is handled the
+// same way.  Halves share the split line, so no border pixel is ever
+// computed twice.  Rectangles smaller than MIN_SIZE are computed
+// pixel by pixel.
+//
+
+static constexpr int TILE_SIZE = 64;
+static constexpr int MIN_SIZE = 6;
+
+// Marks pixels of the tile being rendered that are not computed yet.
+static constexpr int UNKNOWN = -1;
+
+typedef struct
+{
+    float x0, y0, x1, y1;
+    int width, height;
+    int maxIterations;
+    int *output;
+    long long computed;
+} MarianiContext;
+
+static inline int pixelAt(MarianiContext *ctx, int i, int j)
+{
+    int &value = ctx->output[j * ctx->width + i];
+    if (value == UNKNOWN)
+    {
+        value = mandelbrotPixel(ctx->x0, ctx->y0, ctx->x1, ctx->y1,
+                                ctx->width, ctx->height, i, j,
+                                ctx->maxIterations);
+        ctx->computed++;
+    }
+    return value;
+}
+
+// Render the inclusive rectangle [i0, i1] x [j0, j1].
+static void subdivide(MarianiContext *ctx, int i0, int j0, int i1, int j1)
+{
+    int first = pixelAt(ctx, i0, j0);
+    bool uniform = true;
+    for (int i = i0; i <= i1; i++)
+    {
+        uniform &= pixelAt(ctx, i, j0) == first;
+        uniform &= pixelAt(ctx, i, j1) == first;
+    }
+    for (int j = j0 + 1; j < j1; j++)
+    {
+        uniform &= pixelAt(ctx, i0, j) == first;
+        uniform &= pixelAt(ctx, i1, j) == first;
+    }
+
+    if (i1 - i0 < 2 || j1 - j0 < 2)
+        return;
+
+    if (uniform)
+    {
+        for (int j = j0 + 1; j < j1; j++)
+            std::fill(ctx->output + j * ctx->width + i0 + 1,
+                      ctx->output + j * ctx->width + i1, first);
+        return;
+    }
+
+    if (i1 - i0 < MIN_SIZE || j1 - j0 < MIN_SIZE)
+    {
+        for (int j = j0 + 1; j < j1; j++)
+            for (int i = i0 + 1; i < i1; i++)
+                pixelAt(ctx, i, j);
+        return;
+    }
+
+    if (i1 - i0 >= j1 - j0)
+    {
+        int mid = (i0 + i1) / 2;
+        subdivide(ctx, i0, j0, mid, j1);
+        subdivide(ctx, mid, j0, i1, j1);
+    }
+    else
+    {
+        int mid = (j0 + j1) / 2;
+        subdivide(ctx, i0, j0, i1, mid);
+        subdivide(ctx, i0, mid, i1, j1);
+    }
+}
+
+//
+// MandelbrotMarianiSilver --
+//
+// Parallel Mariani-Silver renderer over the shared thread pool.  Fills
+// output[] like mandelbrotSerial() and returns, through
+// computedPixels, how many pixels were actually iterated.
+void mandelbrotMarianiSilver(
+    int numThreads,
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int maxIterations, int output[],
+    long long *computedPixels)
+{
+    if (numThreads < 1)
+    {
+        fprintf(stderr, "Error: Need at least one thread\n");
+        exit(1);
+    }
+
+    int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    int numTiles = tilesX * tilesY;
+    std::atomic<int> nextTile(0);
+    std::atomic<long long> computed(0);
+
+    ThreadPool::shared().run(numThreads, [&](int, int) {
+        MarianiContext ctx = {x0, y0, x1, y1, width, height, maxIterations, output, 0};
+        int tile;
+        while ((tile = nextTile.fetch_add(1, std::memory_order_relaxed)) < numTiles)
+        {
+            int i0 = (tile % tilesX) * TILE_SIZE;
+            int j0 = (tile / tilesX) * TILE_SIZE;
+            int i1 = std::min(i0 + TILE_SIZE, width) - 1;
+            int j1 = std::min(j0 + TILE_SIZE, height) - 1;
+
+            for (int j = j0; j <= j1; j++)
+                std::fill(output + j * width + i0, output + j * width + i1 + 1, UNKNOWN);
+            subdivide(&ctx, i0, j0, i1, j1);
+        }
+        computed.fetch_add(ctx.computed, std::memory_order_relaxed);
+    });
+
+    if (computedPixels)
+        *computedPixels = computed.load();
+}
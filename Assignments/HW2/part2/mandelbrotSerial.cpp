@@ -37,6 +37,9 @@
    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <atomic>
+#include <complex>
+
 static inline int mandel(float c_re, float c_im, int count)
 {
   float z_re = c_re, z_im = c_im;
@@ -91,3 +94,156 @@ void mandelbrotSerial(
     }
   }
 }
+
+//
+// Interior-set short circuits.
+//
+// Points in the main cardioid or the period-2 bulb never escape, so
+// mandel() would spend maxIterations on them.  The tests below only
+// accept points whose attracting cycle has multiplier |lambda| <= 0.95,
+// a margin that keeps the float orbit far away from escaping, so the
+// returned count is exactly what mandel() would return.
+//
+
+static std::atomic<long long> bulbPixels(0);
+static std::atomic<long long> cyclePixels(0);
+
+static inline bool inMainBulbs(float c_re, float c_im)
+{
+  const double margin = 0.95;
+  double x = c_re, y = c_im;
+
+  // Period-2 bulb: the 2-cycle has multiplier 4(c + 1).
+  if ((x + 1.0) * (x + 1.0) + y * y <= (margin / 4.0) * (margin / 4.0))
+    return true;
+
+  // Cheap exact cardioid test first; only points that pass pay for the
+  // complex sqrt that measures the fixed point's multiplier
+  // 1 - sqrt(1 - 4c) against the margin.
+  double q = (x - 0.25) * (x - 0.25) + y * y;
+  if (q * (q + (x - 0.25)) > 0.25 * y * y)
+    return false;
+
+  std::complex<double> c(x, y);
+  return std::abs(1.0 - std::sqrt(1.0 - 4.0 * c)) <= margin;
+}
+
+//
+// Same iteration as mandel(), with Brent-style periodicity checking:
+// z is saved at doubling intervals and if the orbit ever returns to
+// the saved value exactly, the float iteration is periodic and can
+// never escape.  Sets *cycled when that happens.
+static inline int mandelPeriodic(float c_re, float c_im, int count, bool *cycled)
+{
+  float z_re = c_re, z_im = c_im;
+  float saved_re = z_re, saved_im = z_im;
+  int period = 0, limit = 8;
+  int i;
+  for (i = 0; i < count; ++i)
+  {
+
+    if (z_re * z_re + z_im * z_im > 4.f)
+      break;
+
+    float new_re = z_re * z_re - z_im * z_im;
+    float new_im = 2.f * z_re * z_im;
+    z_re = c_re + new_re;
+    z_im = c_im + new_im;
+
+    if (z_re == saved_re && z_im == saved_im)
+    {
+      *cycled = true;
+      return count;
+    }
+    if (++period == limit)
+    {
+      period = 0;
+      limit *= 2;
+      saved_re = z_re;
+      saved_im = z_im;
+    }
+  }
+
+  return i;
+}
+
+//
+// MandelbrotSerialInterior --
+//
+// Drop-in replacement for mandelbrotSerial() that short-circuits
+// interior points, either analytically (main cardioid and period-2
+// bulb) or by detecting a cycle in the orbit.  Produces the same
+// iteration counts as mandelbrotSerial().
+void mandelbrotSerialInterior(
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int startRow, int totalRows,
+    int maxIterations,
+    int output[])
+{
+  float dx = (x1 - x0) / width;
+  float dy = (y1 - y0) / height;
+
+  int endRow = startRow + totalRows;
+  long long bulbs = 0, cycles = 0;
+
+  for (int j = startRow; j < endRow; j++)
+  {
+    for (int i = 0; i < width; ++i)
+    {
+      float x = x0 + i * dx;
+      float y = y0 + j * dy;
+
+      int index = (j * width + i);
+      if (inMainBulbs(x, y))
+      {
+        output[index] = maxIterations;
+        bulbs++;
+        continue;
+      }
+
+      bool cycled = false;
+      output[index] = mandelPeriodic(x, y, maxIterations, &cycled);
+      cycles += cycled;
+    }
+  }
+
+  bulbPixels.fetch_add(bulbs, std::memory_order_relaxed);
+  cyclePixels.fetch_add(cycles, std::memory_order_relaxed);
+}
+
+//
+// Reset / read the number of pixels mandelbrotSerialInterior()
+// short-circuited by the bulb test and by cycle detection.
+void resetInteriorStats()
+{
+  bulbPixels = 0;
+  cyclePixels = 0;
+}
+
+void getInteriorStats(long long *bulbs, long long *cycles)
+{
+  *bulbs = bulbPixels.load();
+  *cycles = cyclePixels.load();
+}
+
+//
+// MandelbrotPixel --
+//
+// Iteration count of the single pixel (i, j) of the image that
+// mandelbrotSerial() computes for the same viewport, evaluated with
+// the same float arithmetic.
+int mandelbrotPixel(
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int i, int j,
+    int maxIterations)
+{
+  float dx = (x1 - x0) / width;
+  float dy = (y1 - y0) / height;
+
+  float x = x0 + i * dx;
+  float y = y0 + j * dy;
+
+  return mandel(x, y, maxIterations);
+}
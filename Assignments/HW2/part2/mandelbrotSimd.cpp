@@ -0,0 +1,194 @@
+#include <immintrin.h>
+
+extern void mandelbrotSerial(
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int startRow, int totalRows,
+    int maxIterations,
+    int output[]);
+
+//
+// The vector kernels below evaluate exactly the same float operations
+// as mandel() in mandelbrotSerial.cpp, in the same order, so their
+// iteration counts are bit-identical to the serial image.  Escaped
+// lanes are masked out of the count and the loop exits as soon as
+// every lane in the vector has escaped.  This file is built with
+// -ffp-contract=off so the compiler never fuses mul/add pairs into
+// FMAs, which would round differently from the scalar code.
+//
+
+__attribute__((target("avx2"))) static void mandelRowsAVX2(
+    float x0, float y0, float dx, float dy,
+    int width, int startRow, int endRow,
+    int maxIterations,
+    int output[])
+{
+  const __m256 four = _mm256_set1_ps(4.f);
+  const __m256 two = _mm256_set1_ps(2.f);
+  const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  alignas(32) int tail[8];
+
+  for (int j = startRow; j < endRow; j++)
+  {
+    float y = y0 + j * dy;
+    __m256 c_im = _mm256_set1_ps(y);
+
+    for (int i = 0; i < width; i += 8)
+    {
+      // Column indices are exact in float for widths below 2^24.
+      __m256 idx = _mm256_add_ps(_mm256_set1_ps((float)i), lanes);
+      __m256 c_re = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_mul_ps(idx, _mm256_set1_ps(dx)));
+      __m256 z_re = c_re, z_im = c_im;
+      __m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+      __m256i count = _mm256_setzero_si256();
+
+      for (int k = 0; k < maxIterations; ++k)
+      {
+        __m256 re2 = _mm256_mul_ps(z_re, z_re);
+        __m256 im2 = _mm256_mul_ps(z_im, z_im);
+        // Lanes stay active while !(|z|^2 > 4), matching the scalar break.
+        active = _mm256_and_ps(active, _mm256_cmp_ps(_mm256_add_ps(re2, im2), four, _CMP_NGT_UQ));
+        if (_mm256_movemask_ps(active) == 0)
+          break;
+        // active lanes are all ones (-1), so subtracting adds one.
+        count = _mm256_sub_epi32(count, _mm256_castps_si256(active));
+
+        __m256 new_re = _mm256_sub_ps(re2, im2);
+        __m256 new_im = _mm256_mul_ps(_mm256_mul_ps(two, z_re), z_im);
+        z_re = _mm256_add_ps(c_re, new_re);
+        z_im = _mm256_add_ps(c_im, new_im);
+      }
+
+      int *dst = output + j * width + i;
+      if (i + 8 <= width)
+      {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), count);
+      }
+      else
+      {
+        _mm256_store_si256(reinterpret_cast<__m256i *>(tail), count);
+        for (int l = 0; l < width - i; ++l)
+          dst[l] = tail[l];
+      }
+    }
+  }
+}
+
+__attribute__((target("avx512f"))) static void mandelRowsAVX512(
+    float x0, float y0, float dx, float dy,
+    int width, int startRow, int endRow,
+    int maxIterations,
+    int output[])
+{
+  const __m512 four = _mm512_set1_ps(4.f);
+  const __m512 two = _mm512_set1_ps(2.f);
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512 lanes = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7,
+                                      8, 9, 10, 11, 12, 13, 14, 15);
+
+  for (int j = startRow; j < endRow; j++)
+  {
+    float y = y0 + j * dy;
+    __m512 c_im = _mm512_set1_ps(y);
+
+    for (int i = 0; i < width; i += 16)
+    {
+      __m512 idx = _mm512_add_ps(_mm512_set1_ps((float)i), lanes);
+      __m512 c_re = _mm512_add_ps(_mm512_set1_ps(x0), _mm512_mul_ps(idx, _mm512_set1_ps(dx)));
+      __m512 z_re = c_re, z_im = c_im;
+      __mmask16 active = 0xFFFF;
+      __m512i count = _mm512_setzero_si512();
+
+      for (int k = 0; k < maxIterations; ++k)
+      {
+        __m512 re2 = _mm512_mul_ps(z_re, z_re);
+        __m512 im2 = _mm512_mul_ps(z_im, z_im);
+        active = _mm512_mask_cmp_ps_mask(active, _mm512_add_ps(re2, im2), four, _CMP_NGT_UQ);
+        if (active == 0)
+          break;
+        count = _mm512_mask_add_epi32(count, active, count, one);
+
+        __m512 new_re = _mm512_sub_ps(re2, im2);
+        __m512 new_im = _mm512_mul_ps(_mm512_mul_ps(two, z_re), z_im);
+        z_re = _mm512_add_ps(c_re, new_re);
+        z_im = _mm512_add_ps(c_im, new_im);
+      }
+
+      int remaining = width - i;
+      __mmask16 storeMask = remaining >= 16 ? 0xFFFF : (__mmask16)((1u << remaining) - 1);
+      _mm512_mask_storeu_epi32(output + j * width + i, storeMask, count);
+    }
+  }
+}
+
+enum SimdLevel
+{
+  SIMD_NONE,
+  SIMD_AVX2,
+  SIMD_AVX512,
+};
+
+static SimdLevel detectSimdLevel()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return SIMD_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+  return SIMD_NONE;
+}
+
+static SimdLevel simdLevel()
+{
+  static const SimdLevel level = detectSimdLevel();
+  return level;
+}
+
+//
+// mandelbrotSimdIsa --
+//
+// Name of the instruction set mandelbrotSimd() dispatches to.
+const char *mandelbrotSimdIsa()
+{
+  switch (simdLevel())
+  {
+  case SIMD_AVX512:
+    return "avx512";
+  case SIMD_AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+//
+// MandelbrotSimd --
+//
+// Drop-in replacement for mandelbrotSerial() that iterates 16
+// (AVX-512) or 8 (AVX2) pixels of a row at once.  Falls back to
+// mandelbrotSerial() on machines without AVX2.
+void mandelbrotSimd(
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int startRow, int totalRows,
+    int maxIterations,
+    int output[])
+{
+  float dx = (x1 - x0) / width;
+  float dy = (y1 - y0) / height;
+
+  int endRow = startRow + totalRows;
+
+  switch (simdLevel())
+  {
+  case SIMD_AVX512:
+    mandelRowsAVX512(x0, y0, dx, dy, width, startRow, endRow, maxIterations, output);
+    break;
+  case SIMD_AVX2:
+    mandelRowsAVX2(x0, y0, dx, dy, width, startRow, endRow, maxIterations, output);
+    break;
+  default:
+    mandelbrotSerial(x0, y0, x1, y1, width, height, startRow, totalRows, maxIterations, output);
+    break;
+  }
+}
@@ -1,6 +1,29 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "CycleTimer.h"
+#include "ThreadPool.h"
+#include "mandelbrotThread.h"
+
+typedef void (*RowKernel)(
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int startRow, int numRows,
+    int maxIterations,
+    int output[]);
+
+// One block of rows computed by one thread, for tracing.
+typedef struct
+{
+    int startRow;
+    int numRows;
+    double beginSeconds;
+    double endSeconds;
+    long long escapeCounts;
+} TraceBlock;
 
 typedef struct
 {
@@ -12,8 +35,96 @@ typedef struct
     int *output;
     int threadId;
     int numThreads;
+    ScheduleMode schedule;
+    int tileRows;
+    RowKernel kernel;
+    RowSink sink;
+    void *sinkContext;
+    std::atomic<int> *nextRow;
+    double callStart;
+    ThreadStats stats;
+    std::vector<TraceBlock> *trace;
 } WorkerArgs;
 
+static ScheduleMode scheduleMode = SCHEDULE_STATIC;
+static int scheduleTileRows = 1;
+static MandelKernel threadKernel = KERNEL_SCALAR;
+static RowSink rowSink = NULL;
+static void *rowSinkContext = NULL;
+static bool tracing = false;
+static std::vector<ThreadStats> lastStats;
+static std::vector<std::vector<TraceBlock>> lastTrace;
+
+void setThreadSchedule(ScheduleMode mode, int tileRows)
+{
+    scheduleMode = mode;
+    scheduleTileRows = std::max(1, tileRows);
+}
+
+void setThreadKernel(MandelKernel kernel)
+{
+    threadKernel = kernel;
+}
+
+void setThreadRowSink(RowSink sink, void *context)
+{
+    rowSink = sink;
+    rowSinkContext = context;
+}
+
+void setThreadTracing(bool enabled)
+{
+    tracing = enabled;
+}
+
+ThreadStats getThreadStats(int threadId)
+{
+    if (threadId < 0 || threadId >= static_cast<int>(lastStats.size()))
+        return ThreadStats();
+    return lastStats[threadId];
+}
+
+double getThreadBusyTime(int threadId)
+{
+    ThreadStats stats = getThreadStats(threadId);
+    return stats.endSeconds - stats.startSeconds;
+}
+
+bool writeThreadTrace(const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    if (!fp)
+    {
+        perror(filename);
+        return false;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    for (size_t t = 0; t < lastTrace.size(); t++)
+    {
+        fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %zu, "
+                    "\"args\": {\"name\": \"thread %zu\"}}",
+                first ? "" : ",\n", t, t);
+        first = false;
+        for (const TraceBlock &block : lastTrace[t])
+        {
+            fprintf(fp, ",\n{\"name\": \"rows %d-%d\", \"cat\": \"mandelbrot\", \"ph\": \"X\", "
+                        "\"pid\": 0, \"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f, "
+                        "\"args\": {\"rows\": %d, \"escape count sum\": %lld}}",
+                    block.startRow, block.startRow + block.numRows - 1, t,
+                    block.beginSeconds * 1e6, (block.endSeconds - block.beginSeconds) * 1e6,
+                    block.numRows, block.escapeCounts);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    bool ok = !ferror(fp);
+    if (fclose(fp) != 0)
+        ok = false;
+    return ok;
+}
+
 extern void mandelbrotSerial(
     float x0, float y0, float x1, float y1,
     int width, int height,
@@ -21,6 +132,74 @@ extern void mandelbrotSerial(
     int maxIterations,
     int output[]);
 
+extern void mandelbrotSimd(
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int startRow, int numRows,
+    int maxIterations,
+    int output[]);
+
+extern void mandelbrotSerialInterior(
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int startRow, int numRows,
+    int maxIterations,
+    int output[]);
+
+extern void mandelbrotCached(
+    int numThreads,
+    float x0, float y0, float x1, float y1,
+    int width, int height,
+    int maxIterations, int output[],
+    double busySeconds[]);
+
+static RowKernel rowKernel(MandelKernel kernel)
+{
+    switch (kernel)
+    {
+    case KERNEL_SIMD:
+        return mandelbrotSimd;
+    case KERNEL_INTERIOR:
+        return mandelbrotSerialInterior;
+    default:
+        return mandelbrotSerial;
+    }
+}
+
+//
+// computeBlock --
+//
+// Compute one block of rows and account for it in the thread's stats.
+static void computeBlock(WorkerArgs *const args, int startRow, int numRows)
+{
+    double begin = args->trace ? CycleTimer::currentSeconds() : 0.0;
+
+    args->kernel(
+        args->x0, args->y0, args->x1, args->y1,
+        args->width, args->height,
+        startRow, numRows,
+        args->maxIterations,
+        args->output);
+
+    args->stats.rows += numRows;
+
+    // The escape counts take another pass over the block, so they are
+    // only summed for traced calls.
+    if (args->trace)
+    {
+        double end = CycleTimer::currentSeconds();
+        long long escapeCounts = 0;
+        const int *counts = args->output + startRow * args->width;
+        for (unsigned int i = 0; i < numRows * args->width; i++)
+            escapeCounts += counts[i];
+        args->stats.escapeCounts += escapeCounts;
+        args->trace->push_back({startRow, numRows, begin - args->callStart,
+                                end - args->callStart, escapeCounts});
+    }
+    if (args->sink)
+        args->sink(args->sinkContext, args->output, startRow, numRows);
+}
+
 //
 // workerThreadStart --
 //
@@ -49,61 +228,68 @@ void workerThreadStart(WorkerArgs *const args)
     // float dx = (args->x1 - args->x0) / args->width;
     // float dy = (args->y1 - args->y0) / args->height;
 
-    for ( unsigned int m = 0; m < args->height; m-=-args->numThreads){
-        mandelbrotSerial(
-            args->x0, args->y0, args->x1, args->y1,
-            args->width, args->height,
-            m+args->threadId, 1,
-            args->maxIterations,
-            args->output
-        );
-    
-        // j = m+args->threadId;
-        // for (i = 0; i < args->width; ++i)
-        // {
-        //     x = args->x0 + i * dx;
-        //     y = args->y0 + j * dy;
-
-        //     index = (j * args->width + i);
-
-        //     z_re = x;
-        //     z_im = y;
-        //     for(k=0; k < args->maxIterations; ++k){
-        //         if (z_re * z_re + z_im * z_im > 4.f)
-        //             break;
-        //         new_re = z_re * z_re - z_im * z_im;
-        //         new_im = 2.f * z_re * z_im;
-        //         z_re = x + new_re;
-        //         z_im = y + new_im;
-        //     }
-        //     args->output[index] = k;
-        // }
+    args->stats.startSeconds = CycleTimer::currentSeconds() - args->callStart;
+    int height = args->height;
+    int tileRows = args->tileRows;
+
+    if (args->schedule == SCHEDULE_DYNAMIC)
+    {
+        // Grab the next block of rows until the image is exhausted.
+        int startRow;
+        while ((startRow = args->nextRow->fetch_add(tileRows, std::memory_order_relaxed)) < height)
+        {
+            computeBlock(args, startRow, std::min(tileRows, height - startRow));
+        }
+    }
+    else
+    {
+        // Blocks of tileRows rows dealt round-robin to the threads.
+        int stride = args->numThreads * tileRows;
+        for (int startRow = args->threadId * tileRows; startRow < height; startRow += stride)
+        {
+            computeBlock(args, startRow, std::min(tileRows, height - startRow));
+        }
     }
 
+    args->stats.endSeconds = CycleTimer::currentSeconds() - args->callStart;
 }
 
 //
 // MandelbrotThread --
 //
 // Multi-threaded implementation of mandelbrot set image generation.
-// Threads of execution are created by spawning std::threads.
+// Work runs on the shared persistent ThreadPool, so only the first call
+// with a given thread count pays for spawning std::threads.
 void mandelbrotThread(
     int numThreads,
     float x0, float y0, float x1, float y1,
     int width, int height,
     int maxIterations, int output[])
 {
-    static constexpr int MAX_THREADS = 32;
-
-    if (numThreads > MAX_THREADS)
+    if (numThreads < 1)
     {
-        fprintf(stderr, "Error: Max allowed threads is %d\n", MAX_THREADS);
+        fprintf(stderr, "Error: Need at least one thread\n");
         exit(1);
     }
 
-    // Creates thread objects that do not yet represent a thread.
-    std::thread workers[MAX_THREADS];
-    WorkerArgs args[MAX_THREADS] = {};
+    if (tileCacheEnabled())
+    {
+        std::vector<double> busySeconds(numThreads, 0.0);
+        mandelbrotCached(numThreads, x0, y0, x1, y1, width, height,
+                         maxIterations, output, busySeconds.data());
+        lastStats.assign(numThreads, ThreadStats());
+        lastTrace.assign(numThreads, std::vector<TraceBlock>());
+        for (int i = 0; i < numThreads; i++)
+            lastStats[i].endSeconds = busySeconds[i];
+        if (rowSink)
+            rowSink(rowSinkContext, output, 0, height);
+        return;
+    }
+
+    std::vector<WorkerArgs> args(numThreads);
+    lastTrace.assign(numThreads, std::vector<TraceBlock>());
+    double callStart = CycleTimer::currentSeconds();
+    std::atomic<int> nextRow(0);
 
     for (int i = 0; i < numThreads; i++)
     {
@@ -119,23 +305,28 @@ void mandelbrotThread(
         args[i].maxIterations = maxIterations;
         args[i].numThreads = numThreads;
         args[i].output = output;
+        args[i].schedule = scheduleMode;
+        args[i].tileRows = scheduleTileRows;
+        args[i].nextRow = &nextRow;
+        args[i].kernel = rowKernel(threadKernel);
+        args[i].sink = rowSink;
+        args[i].sinkContext = rowSinkContext;
+        args[i].callStart = callStart;
+        args[i].stats = ThreadStats();
+        args[i].trace = tracing ? &lastTrace[i] : NULL;
 
         args[i].threadId = i;
     }
 
-    // Spawn the worker threads.  Note that only numThreads-1 std::threads
-    // are created and the main application thread is used as a worker
-    // as well.
-    for (int i = 1; i < numThreads; i++)
-    {
-        workers[i] = std::thread(workerThreadStart, &args[i]);
-    }
+    // The pool runs thread 0 on the main application thread and the
+    // rest on its parked workers, and returns once all have finished.
+    ThreadPool::shared().run(numThreads, [&](int threadId, int) {
+        workerThreadStart(&args[threadId]);
+    });
 
-    workerThreadStart(&args[0]);
-
-    // join worker threads
-    for (int i = 1; i < numThreads; i++)
+    lastStats.assign(numThreads, ThreadStats());
+    for (int i = 0; i < numThreads; i++)
     {
-        workers[i].join();
+        lastStats[i] = args[i].stats;
     }
 }
@@ -0,0 +1,106 @@
+#ifndef _MANDELBROT_THREAD_H_
+#define _MANDELBROT_THREAD_H_
+
+// Row scheduling policies used by mandelbrotThread().
+//
+// * SCHEDULE_STATIC interleaves blocks of tileRows rows across the
+//   threads up front (tileRows = 1 is plain row interleaving).
+// * SCHEDULE_DYNAMIC hands out blocks of tileRows rows from a shared
+//   atomic counter, so a thread that finishes early keeps taking work.
+enum ScheduleMode
+{
+    SCHEDULE_STATIC = 0,
+    SCHEDULE_DYNAMIC = 1,
+};
+
+// Per-block kernel run by each worker thread.
+//
+// * KERNEL_SCALAR calls mandelbrotSerial(), one pixel at a time.
+// * KERNEL_SIMD calls mandelbrotSimd(), 8 (AVX2) or 16 (AVX-512)
+//   pixels at a time, with bit-identical results.
+// * KERNEL_INTERIOR calls mandelbrotSerialInterior(), which skips the
+//   main cardioid and period-2 bulb and stops on periodic orbits,
+//   again with bit-identical results.
+enum MandelKernel
+{
+    KERNEL_SCALAR = 0,
+    KERNEL_SIMD = 1,
+    KERNEL_INTERIOR = 2,
+};
+
+// Select the scheduling policy and block size for later calls to
+// mandelbrotThread().  Defaults to SCHEDULE_STATIC with 1-row blocks.
+void setThreadSchedule(ScheduleMode mode, int tileRows);
+
+// Select the kernel used by later calls to mandelbrotThread().
+// Defaults to KERNEL_SCALAR.
+void setThreadKernel(MandelKernel kernel);
+
+// Name of the instruction set KERNEL_SIMD runs on this machine
+// ("avx512", "avx2" or "scalar").
+const char *mandelbrotSimdIsa();
+
+// Pixels short-circuited by KERNEL_INTERIOR since the last reset,
+// split into bulb-test hits and detected orbit cycles.
+void resetInteriorStats();
+void getInteriorStats(long long *bulbs, long long *cycles);
+
+// Route later mandelbrotThread() calls through an iteration-count tile
+// cache holding up to maxTiles 64x64 tiles (~48 KB each); 0 disables
+// and empties it.  Cached renders snap the view onto a pixel lattice
+// fixed by the first view at that scale, reuse the pixels a pan by a
+// whole number of pixels shares with earlier views, and resume
+// iterating from the cached escape state when maxIterations rises.
+// Every pixel is evaluated at its lattice coordinate, so the image is
+// identical to rendering the snapped view with no tiles cached; it can
+// differ from an uncached mandelbrotThread() of a panned corner in the
+// rounding of c.  Cached renders use the scalar kernel and a dynamic
+// tile schedule.
+void setTileCache(int maxTiles);
+bool tileCacheEnabled();
+
+// Drop every cached tile but keep the lattices, so later renders land
+// on the same pixel coordinates and compute all their tiles afresh.
+void flushTileCache();
+
+// Callback run by a worker thread as soon as it has finished rows
+// [startRow, startRow + numRows) of output, e.g. to color-map and write
+// them while other rows are still being computed.  It is called
+// concurrently from several threads, for disjoint rows.  Cached renders
+// report the whole image at once.  Pass NULL to disable.
+typedef void (*RowSink)(void *context, const int *output, int startRow, int numRows);
+void setThreadRowSink(RowSink sink, void *context);
+
+// Tiles served from the cache unchanged, resumed to a higher
+// maxIterations, or computed from scratch since the last reset.
+void resetTileCacheStats();
+void getTileCacheStats(long long *reused, long long *resumed, long long *computed);
+
+// Seconds thread threadId spent computing rows during the most
+// recent mandelbrotThread() call.
+double getThreadBusyTime(int threadId);
+
+// What thread threadId did during the most recent mandelbrotThread()
+// call.  Times are seconds since the call started.  escapeCounts is
+// the sum of the escape counts of the pixels it computed, summed only
+// while tracing is enabled; it is not the work done, since interior
+// short circuits report maxIterations for pixels they never iterate.
+// Cached renders only report times.
+typedef struct
+{
+    double startSeconds;
+    double endSeconds;
+    int rows;
+    long long escapeCounts;
+} ThreadStats;
+
+ThreadStats getThreadStats(int threadId);
+
+// While tracing is enabled, every block of rows a thread computes is
+// recorded.  writeThreadTrace() saves the blocks of the most recent
+// mandelbrotThread() call as Chrome trace JSON (chrome://tracing or
+// ui.perfetto.dev), one track per thread.  Returns false on I/O error.
+void setThreadTracing(bool enabled);
+bool writeThreadTrace(const char *filename);
+
+#endif // #ifndef _MANDELBROT_THREAD_H_
@@ -1,10 +1,50 @@
+#include <getopt.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "cg_impl.h"
+#include "cg_numa.h"
 #include "globals.h"
 #include "timers.h"
 
+//---------------------------------------------------------------------
+// The reference zeta of each class, for verifying runtime-sized problems
+//---------------------------------------------------------------------
+static const struct
+{
+    int na;
+    int nonzer;
+    double shift;
+    int niter;
+    double zeta;
+} known_results[] = {
+    {7000, 8, 12, 15, 10.362595087124},
+    {14000, 11, 20, 15, 17.130235054029},
+    {75000, 13, 60, 75, 22.712745482631},
+};
+
+static void usage(const char *progname)
+{
+    printf("Usage: %s [options]\n", progname);
+    printf("Program Options:\n");
+    printf("  -f  --format <F>   SpMV matrix format: csr, sell or mixed (Default = csr)\n");
+    printf("  -K  --kernel <K>   CSR SpMV kernel: csr, unroll2, unroll8, rows2, prefetch or auto (Default = csr)\n");
+    printf("  -c  --cg <V>       CG variant: classic or pipelined (Default = classic)\n");
+    printf("  -r  --reorder <R>  Matrix row order: none or rcm (Default = none)\n");
+    printf("  -e  --tolerance <T> Stop CG once ||r|| / ||r0|| < T (Default = 0, all 25 steps)\n");
+    printf("  -p  --precond <P>  Preconditioner for classic CG: none or jacobi (Default = none)\n");
+    printf("  -k  --rhs <K>      Solve K right-hand sides together, 1 to %d; K > 1 needs classic CG on CSR with no -e or -p (Default = 1)\n", CG_MAX_RHS);
+    printf("  -n  --size <N>     Matrix order (Default = %d)\n", NA);
+    printf("  -z  --nonzer <N>   Nonzeros per generated vector (Default = %d)\n", NONZER);
+    printf("  -s  --shift <S>    Main diagonal shift (Default = %g)\n", (double)SHIFT);
+    printf("  -i  --iterations <N> Outer iterations (Default = %d)\n", NITER);
+    printf("  -t  --timers       Print a per-phase time, GB/s and GFLOP/s breakdown\n");
+    printf("  -N  --numa <P>     Page placement: first-touch or interleave (Default = first-touch)\n");
+    printf("  -?  --help         This message\n");
+}
+
 int main(int argc, char *argv[])
 {
     int i, j, k, it;
@@ -17,21 +57,206 @@ int main(int argc, char *argv[])
 
     char *t_names[T_LAST];
 
+    int na = NA;
+    int nonzer = NONZER;
+    double shift = SHIFT;
+    int niter = NITER;
+    int nrhs = 1;
+    cg_problem pb;
+    cg_block blk;
+    double zetas[CG_MAX_RHS];
+    // settings the multi-RHS path cannot run: it is classic CG on CSR
+    const char *format_name = "csr";
+    const char *kernel_name = "csr";
+    const char *variant_name = "classic";
+    double tolerance = 0.0;
+    bool jacobi = false;
+
+    static struct option long_options[] = {
+        {"format", 1, 0, 'f'},
+        {"kernel", 1, 0, 'K'},
+        {"cg", 1, 0, 'c'},
+        {"reorder", 1, 0, 'r'},
+        {"tolerance", 1, 0, 'e'},
+        {"precond", 1, 0, 'p'},
+        {"rhs", 1, 0, 'k'},
+        {"size", 1, 0, 'n'},
+        {"nonzer", 1, 0, 'z'},
+        {"shift", 1, 0, 's'},
+        {"iterations", 1, 0, 'i'},
+        {"numa", 1, 0, 'N'},
+        {"timers", 0, 0, 't'},
+        {"help", 0, 0, '?'},
+        {0, 0, 0, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:K:c:r:e:p:k:n:z:s:i:N:t?", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                if (strcmp(optarg, "csr") == 0)
+                    set_spmv_format(SPMV_CSR);
+                else if (strcmp(optarg, "sell") == 0)
+                    set_spmv_format(SPMV_SELL);
+                else if (strcmp(optarg, "mixed") == 0)
+                    set_spmv_format(SPMV_MIXED);
+                else
+                {
+                    fprintf(stderr, "Unknown matrix format %s\n", optarg);
+                    return 1;
+                }
+                format_name = optarg;
+                break;
+            case 'K':
+                if (!set_csr_kernel(optarg))
+                {
+                    fprintf(stderr, "Unknown SpMV kernel %s\n", optarg);
+                    return 1;
+                }
+                kernel_name = optarg;
+                break;
+            case 'c':
+                if (strcmp(optarg, "classic") == 0)
+                    set_cg_variant(CG_CLASSIC);
+                else if (strcmp(optarg, "pipelined") == 0)
+                    set_cg_variant(CG_PIPELINED);
+                else
+                {
+                    fprintf(stderr, "Unknown CG variant %s\n", optarg);
+                    return 1;
+                }
+                variant_name = optarg;
+                break;
+            case 'r':
+                if (strcmp(optarg, "rcm") == 0)
+                    set_matrix_reorder(true);
+                else if (strcmp(optarg, "none") == 0)
+                    set_matrix_reorder(false);
+                else
+                {
+                    fprintf(stderr, "Unknown row order %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'e':
+                tolerance = atof(optarg);
+                set_cg_tolerance(tolerance);
+                break;
+            case 'p':
+                if (strcmp(optarg, "jacobi") == 0)
+                    jacobi = true;
+                else if (strcmp(optarg, "none") == 0)
+                    jacobi = false;
+                else
+                {
+                    fprintf(stderr, "Unknown preconditioner %s\n", optarg);
+                    return 1;
+                }
+                set_cg_jacobi(jacobi);
+                break;
+            case 'k':
+                nrhs = atoi(optarg);
+                if (nrhs < 1 || nrhs > CG_MAX_RHS)
+                {
+                    fprintf(stderr, "Right-hand sides must be 1 to %d\n", CG_MAX_RHS);
+                    return 1;
+                }
+                break;
+            case 'n':
+                na = atoi(optarg);
+                break;
+            case 'z':
+                nonzer = atoi(optarg);
+                break;
+            case 's':
+                shift = atof(optarg);
+                break;
+            case 'i':
+                niter = atoi(optarg);
+                break;
+            case 'N':
+                if (strcmp(optarg, "interleave") == 0)
+                {
+                    if (!cg_numa_interleave())
+                        fprintf(stderr, "NUMA is not available, using default placement\n");
+                }
+                else if (strcmp(optarg, "first-touch") != 0)
+                {
+                    fprintf(stderr, "Unknown page placement %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                timeron = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (nrhs > 1
+        && (strcmp(format_name, "csr") != 0 || strcmp(kernel_name, "csr") != 0
+            || strcmp(variant_name, "classic") != 0))
+    {
+        fprintf(stderr, "-k %d runs classic CG on CSR; it cannot be combined with -f %s -K %s -c %s\n",
+                nrhs, format_name, kernel_name, variant_name);
+        return 1;
+    }
+    if (nrhs > 1 && (tolerance > 0.0 || jacobi))
+    {
+        fprintf(stderr, "-k %d always runs all 25 CG steps unpreconditioned; it cannot be "
+                        "combined with -e or -p jacobi\n",
+                nrhs);
+        return 1;
+    }
+
     for (i = 0; i < T_LAST; i++)
     {
         timer_clear(i);
     }
 
-    timer_start(T_INIT);
+    //---------------------------------------------------------------------
+    // The compile-time class runs on the static arrays; any other size
+    // is allocated on the heap.
+    //---------------------------------------------------------------------
+    if (na == NA && nonzer == NONZER && shift == SHIFT)
+    {
+        problem_class(&pb);
+    }
+    else if (!problem_create(&pb, na, nonzer, shift))
+    {
+        fprintf(stderr, "Invalid problem size %d with %d nonzeros per vector\n", na, nonzer);
+        return 1;
+    }
+
+    zeta_verify_value = 0.0;
+    for (i = 0; i < (int)(sizeof(known_results) / sizeof(known_results[0])); i++)
+    {
+        if (known_results[i].na == na && known_results[i].nonzer == nonzer
+            && known_results[i].shift == shift && known_results[i].niter == niter)
+            zeta_verify_value = known_results[i].zeta;
+    }
 
-    zeta_verify_value = VALID_RESULT;
+    timer_start(T_INIT);
 
     printf("\nCG start...\n\n");
-    printf(" Size: %11d\n", NA);
-    printf(" Iterations: %5d\n", NITER);
+    printf(" Size: %11d\n", na);
+    printf(" Iterations: %5d\n", niter);
     printf("\n");
 
-    init(&zeta);
+    problem_init(&pb, &zeta);
+    printf(" Nonzeros: %11d\n", pb.nnz);
+    if (nrhs > 1)
+    {
+        if (!block_create(&blk, &pb, nrhs))
+        {
+            fprintf(stderr, "Out of memory for %d right-hand sides\n", nrhs);
+            return 1;
+        }
+        printf(" Right-hand sides: %d\n", nrhs);
+    }
 
     zeta = 0.0;
 
@@ -42,16 +267,21 @@ int main(int argc, char *argv[])
     //---------------------------------------------------------------------
     for (it = 1; it <= 1; it++)
     {
-        iterate(&zeta, &it);
+        if (nrhs > 1)
+            block_iterate(&pb, &blk, zetas, &it);
+        else
+            problem_iterate(&pb, &zeta, &it);
     } // end of do one iteration untimed
 
     //---------------------------------------------------------------------
     // set starting vector to (1, 1, .... 1)
     //---------------------------------------------------------------------
-    for (i = 0; i < NA + 1; i++)
+    for (i = 0; i < na + 1; i++)
     {
-        x[i] = 1.0;
+        pb.x[i] = 1.0;
     }
+    if (nrhs > 1)
+        block_start(&blk);
 
     zeta = 0.0;
 
@@ -60,6 +290,7 @@ int main(int argc, char *argv[])
     printf(" Initialization time = %15.3f seconds\n", timer_read(T_INIT));
     t_total += timer_read(T_INIT);
 
+    cg_timers_clear();
     timer_start(T_BENCH);
 
     //---------------------------------------------------------------------
@@ -67,9 +298,12 @@ int main(int argc, char *argv[])
     // Main Iteration for inverse power method
     //---->
     //---------------------------------------------------------------------
-    for (it = 1; it <= NITER; it++)
+    for (it = 1; it <= niter; it++)
     {
-        iterate(&zeta, &it);
+        if (nrhs > 1)
+            block_iterate(&pb, &blk, zetas, &it);
+        else
+            problem_iterate(&pb, &zeta, &it);
     } // end of main iter inv pow meth
 
     timer_stop(T_BENCH);
@@ -83,9 +317,28 @@ int main(int argc, char *argv[])
 
     printf("\nComplete...\n");
 
+    //---------------------------------------------------------------------
+    // System 0 starts from the benchmark vector and is the one verified
+    //---------------------------------------------------------------------
+    if (nrhs > 1)
+    {
+        printf("\n   system              ||r||                 zeta\n");
+        for (i = 0; i < nrhs; i++)
+        {
+            printf("    %5d       %20.14E%20.13f\n", i, blk.rnorm[i], zetas[i]);
+        }
+        printf("\n");
+        zeta = zetas[0];
+    }
+
     epsilon = 1.0e-10;
     err = fabs(zeta - zeta_verify_value) / zeta_verify_value;
-    if (err <= epsilon)
+    if (zeta_verify_value == 0.0)
+    {
+        printf(" No reference zeta for this problem size, verification skipped\n");
+        printf(" Zeta is    %20.13E\n", zeta);
+    }
+    else if (err <= epsilon)
     {
         printf(" VERIFICATION SUCCESSFUL\n");
         printf(" Zeta is    %20.13E\n", zeta);
@@ -102,5 +355,14 @@ int main(int argc, char *argv[])
 
     printf("Total Time: %lf seconds\n\n", t_total);
 
+    if (timeron)
+        cg_timers_report();
+
+    cg_numa_report(&pb);
+
+    if (nrhs > 1)
+        block_free(&blk);
+    problem_free(&pb);
+
     return 0;
 }
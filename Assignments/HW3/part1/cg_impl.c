@@ -1,152 +1,786 @@
+#include <limits.h>
 #include <math.h>
+#include <omp.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cg_impl.h"
 #include "randdp.h"
+#include "reorder.h"
+#include "spmv.h"
+#include "timers.h"
 
 //---------------------------------------------------------------------
-// Floaging point arrays here are named as in spec discussion of
-// CG algorithm
+// With the mixed-precision matrix, CG restarts from the true residual
+// x - A.z (in double) every MIXED_RESTART iterations, so z converges to
+// the double-precision solution rather than that of the rounded matrix.
 //---------------------------------------------------------------------
-void conj_grad(const int colidx[], const int rowstr[], const double x[], double z[], const double a[], double p[], double q[], double r[], double *rnorm) {
-    int cgit, cgitmax = 25;
-    double d, sum, rho, rho0, alpha, beta;
+#define MIXED_RESTART 12
 
-    rho = 0.0;
+static enum spmv_format spmv_format = SPMV_CSR;
+static enum cg_variant cg_variant = CG_CLASSIC;
+static bool reorder_rcm = false;
+static double cg_tolerance = 0.0;
+static bool cg_jacobi = false;
+static int csr_choice = 0; // index into csr_kernels, -1 to autotune
 
-    //---------------------------------------------------------------------
-    // Initialize the CG algorithm:
-    //---------------------------------------------------------------------
-    #pragma omp parallel for
-    for (int j = 0; j < naa + 1; j++)
+// the compile-time class used by init() and iterate()
+static cg_problem class_problem;
+
+void set_spmv_format(enum spmv_format format)
+{
+    spmv_format = format;
+}
+
+void set_cg_variant(enum cg_variant variant)
+{
+    cg_variant = variant;
+}
+
+void set_matrix_reorder(bool rcm)
+{
+    reorder_rcm = rcm;
+}
+
+void set_cg_tolerance(double tolerance)
+{
+    cg_tolerance = tolerance;
+}
+
+void set_cg_jacobi(bool jacobi)
+{
+    cg_jacobi = jacobi;
+}
+
+bool set_csr_kernel(const char *name)
+{
+    if (strcmp(name, "auto") == 0)
     {
-        q[j] = 0.0;
-        z[j] = 0.0;
-        r[j] = x[j];
-        p[j] = r[j];
+        csr_choice = -1;
+        return true;
+    }
+    for (int i = 0; i < csr_kernel_count; i++)
+    {
+        if (strcmp(name, csr_kernels[i].name) == 0)
+        {
+            csr_choice = i;
+            return true;
+        }
     }
+    return false;
+}
 
-    //---------------------------------------------------------------------
-    // rho = r.r
-    // Now, obtain the norm of r: First, sum squares of r elements locally...
-    //---------------------------------------------------------------------
-    #pragma omp parallel for reduction(+:rho)
-    for (int j = 0; j < lastcol - firstcol + 1; j++)
+//---------------------------------------------------------------------
+// Phase timers.  Inside a parallel region only the master thread reads
+// the clock, right after the barrier that ends a phase, so a phase is
+// charged its slowest thread and the timers need no locking.  Each
+// phase also accumulates the bytes it streams from memory and the
+// floating point operations it performs, from the vector lengths and
+// matrix sizes (gathers of p are counted once per element of p).
+//---------------------------------------------------------------------
+static double phase_bytes[T_LAST];
+static double phase_flops[T_LAST];
+
+static void phase_end(int t, double bytes, double flops)
+{
+    timer_stop(t);
+    phase_bytes[t] += bytes;
+    phase_flops[t] += flops;
+}
+
+#define PHASE_BEGIN(t)                 \
+    if (timeron)                       \
+    {                                  \
+        _Pragma("omp master")          \
+        timer_start(t);                \
+    }
+
+#define PHASE_END(t, bytes, flops)     \
+    if (timeron)                       \
+    {                                  \
+        _Pragma("omp master")          \
+        phase_end(t, bytes, flops);    \
+    }
+
+void cg_timers_clear(void)
+{
+    for (int t = T_CONJ_GRAD; t < T_LAST; t++)
+    {
+        timer_clear(t);
+        phase_bytes[t] = 0.0;
+        phase_flops[t] = 0.0;
+    }
+}
+
+void cg_timers_report(void)
+{
+    static const char *names[T_LAST] = {
+        [T_CG_INIT] = "cg init",
+        [T_CG_SPMV] = "spmv + p.q",
+        [T_CG_AXPY] = "z, r update + r.r",
+        [T_CG_PUPDATE] = "p update",
+        [T_CG_RESID] = "residual",
+        [T_IT_NORM] = "x.z, z.z",
+        [T_IT_SCALE] = "x = z / |z|",
+    };
+    double total = timer_read(T_CONJ_GRAD) + timer_read(T_IT_NORM) + timer_read(T_IT_SCALE);
+
+    printf(" Phase breakdown:\n");
+    printf("   %-18s %10s %6s %9s %9s\n", "phase", "seconds", "%", "GB/s", "GFLOP/s");
+    for (int t = T_CG_INIT; t < T_LAST; t++)
     {
-        rho = rho + r[j] * r[j];
+        double secs = timer_read(t);
+        if (secs <= 0.0)
+            continue;
+        printf("   %-18s %10.4f %6.1f %9.2f %9.2f\n", names[t], secs,
+               total > 0.0 ? 100.0 * secs / total : 0.0, phase_bytes[t] / secs / 1e9,
+               phase_flops[t] / secs / 1e9);
     }
+    printf("   %-18s %10.4f (barriers and scheduling: %.4f)\n", "conj_grad",
+           timer_read(T_CONJ_GRAD), timer_read(T_CONJ_GRAD) - timer_read(T_CG_INIT)
+           - timer_read(T_CG_SPMV) - timer_read(T_CG_AXPY) - timer_read(T_CG_PUPDATE)
+           - timer_read(T_CG_RESID));
+}
+
+//---------------------------------------------------------------------
+// Bytes one SpMV in the given format streams: the stored matrix, and
+// p read and q written.
+//---------------------------------------------------------------------
+static double spmv_bytes(const cg_problem *pb, enum spmv_format format)
+{
+    const double n = pb->na;
+    double matrix;
+
+    if (format == SPMV_SELL)
+        matrix = (double)pb->sell.slice_ptr[pb->sell.nslices] * (sizeof(double) + sizeof(int))
+                 + (pb->sell.nslices + 1 + pb->sell.nslices * SELL_C) * sizeof(int);
+    else if (format == SPMV_MIXED)
+        matrix = (double)pb->mixed.nnz * (sizeof(float) + sizeof(unsigned short))
+                 + (2 * n + 1) * sizeof(int);
+    else
+        matrix = (double)pb->nnz * (sizeof(double) + sizeof(int)) + (n + 1) * sizeof(int);
+    return matrix + 2.0 * n * sizeof(double);
+}
+
+//---------------------------------------------------------------------
+// Add ||x - A.z||^2 to *sum, leaving A.z in r.  Called by every thread
+// of a parallel region; returns once the sum is complete.
+//---------------------------------------------------------------------
+static void residual_sum(const cg_problem *pb, double *sum)
+{
+    const int n = pb->na;
+    const int *colidx = pb->colidx;
+    const int *rowstr = pb->rowstr;
+    const double *a = pb->a;
+    const double *x = pb->x;
+    const double *z = pb->z;
+    double *r = pb->r;
+    double mine = 0.0;
 
     //---------------------------------------------------------------------
-    //---->
-    // The conj grad iteration loop
-    //---->
+    // Form A.z into r and accumulate (x - A.z)^2 in the same sweep
+    // (a second sweep for SELL, whose slices scatter to permuted rows)
     //---------------------------------------------------------------------
-    // #pragma omp parallel for default(shared) private(nzv)
-    for (cgit = 1; cgit <= cgitmax; cgit++)
+    if (pb->format == SPMV_SELL)
     {
-        //---------------------------------------------------------------------
-        // q = A.p
-        // The partition submatrix-vector multiply: use workspace w
-        //---------------------------------------------------------------------
-        //
-        // NOTE: this version of the multiply is actually (slightly: maybe %5)
-        //       faster on the sp2 on 16 nodes than is the unrolled-by-2 version
-        //       below.   On the Cray t3d, the reverse is true, i.e., the
-        //       unrolled-by-two version is some 10% faster.
-        //       The unrolled-by-8 version below is significantly faster
-        //       on the Cray t3d - overall speed of code is 1.5 times faster.
-        #pragma omp parallel for private(sum)
-        for (int j = 0; j < lastrow - firstrow + 1; j++)
+        #pragma omp for schedule(static)
+        for (int s = 0; s < pb->sell.nslices; s++)
         {
-            sum = 0.0;
-            for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
+            pb->sell.kernel(&pb->sell, s, z, r);
+        }
+
+        #pragma omp for schedule(static) nowait
+        for (int j = 0; j < n; j++)
+        {
+            double d = x[j] - r[j];
+            mine = mine + d * d;
+        }
+    }
+    else
+    {
+        #pragma omp for schedule(static) nowait
+        for (int b = 0; b < (n + CSR_BLOCK - 1) / CSR_BLOCK; b++)
+        {
+            const int begin = b * CSR_BLOCK;
+            const int end = begin + CSR_BLOCK < n ? begin + CSR_BLOCK : n;
+            pb->csr(begin, end, rowstr, colidx, a, z, r, 0.0);
+            for (int j = begin; j < end; j++)
             {
-                sum = sum + a[k] * p[colidx[k]];
+                double d = x[j] - r[j];
+                mine = mine + d * d;
             }
-            q[j] = sum;
         }
+    }
+
+    #pragma omp atomic
+    *sum += mine;
+    #pragma omp barrier
+}
+
+//---------------------------------------------------------------------
+// Pipelined CG (Ghysels and Vanroose, 2014).  Besides p and r it keeps
+// w = A.r, s = A.p and u = A.s up to date by recurrences, so alpha and
+// beta need only r.r and w.r, and both come out of the vector update
+// sweep.  Each step is then one SpMV (q = A.w) and one update sweep,
+// with a single reduction and two barriers instead of two reductions
+// and three barriers.
+//
+// Threads publish their partial dot products in their own padded slot
+// and every thread adds the slots in the same order after the barrier,
+// so all threads see identical alpha and beta without another barrier.
+//---------------------------------------------------------------------
+static int conj_grad_pipelined(const cg_problem *pb, double *rnorm)
+{
+    const int cgitmax = 25;
+    const double tol2 = pb->tolerance * pb->tolerance;
+    const int n = pb->na;
+    const int *colidx = pb->colidx;
+    const int *rowstr = pb->rowstr;
+    const double *a = pb->a;
+    const double *x = pb->x;
+    double *z = pb->z;
+    double *p = pb->p;
+    double *q = pb->q;
+    double *r = pb->r;
+    double *w = pb->w;
+    double *s = pb->s;
+    double *u = pb->u;
+
+    // [thread][0] = r.r, [thread][1] = w.r; 8 doubles apart
+    double (*partial)[8] = malloc(sizeof(double[8]) * omp_get_max_threads());
+    if (partial == NULL)
+    {
+        printf("Out of memory in conj_grad_pipelined\n");
+        exit(EXIT_FAILURE);
+    }
+    double sum = 0.0;
+    int iterations = cgitmax;
+
+    // CSR stands in for the mixed format here
+    const enum spmv_format format = pb->format == SPMV_SELL ? SPMV_SELL : SPMV_CSR;
+    const int nblocks = (n + CSR_BLOCK - 1) / CSR_BLOCK;
+    const double n8 = sizeof(double) * (double)n;
+    const double nnz2 = 2.0 * pb->nnz;
+
+    #pragma omp parallel
+    {
+        const int me = omp_get_thread_num();
+        const int nthreads = omp_get_num_threads();
+        double gamma, delta, gamma0 = 0.0, gamma_old = 0.0, alpha = 0.0, beta;
+        double rr = 0.0, wr = 0.0;
+        int used = cgitmax;
+
+        PHASE_BEGIN(T_CG_INIT);
 
         //---------------------------------------------------------------------
-        // Obtain p.q
+        // z = 0, r = x, and the recurrence vectors start from zero
         //---------------------------------------------------------------------
-        d = 0.0;
-        for (int j = 0; j < lastcol - firstcol + 1; j++)
+        #pragma omp for schedule(static)
+        for (int j = 0; j < n + 1; j++)
         {
-            d = d + p[j] * q[j];
+            q[j] = 0.0;
+            z[j] = 0.0;
+            r[j] = x[j];
+            p[j] = 0.0;
+            w[j] = 0.0;
+            s[j] = 0.0;
+            u[j] = 0.0;
         }
 
         //---------------------------------------------------------------------
-        // Obtain alpha = rho / (p.q)
+        // w = A.r, with r.r and w.r in the same sweep
         //---------------------------------------------------------------------
-        alpha = rho / d;
+        if (pb->format == SPMV_SELL)
+        {
+            #pragma omp for schedule(static) nowait
+            for (int sl = 0; sl < pb->sell.nslices; sl++)
+            {
+                wr = wr + pb->sell.kernel(&pb->sell, sl, r, w);
+            }
+            #pragma omp for schedule(static) nowait
+            for (int j = 0; j < n; j++)
+            {
+                rr = rr + r[j] * r[j];
+            }
+        }
+        else
+        {
+            #pragma omp for schedule(static) nowait
+            for (int b = 0; b < nblocks; b++)
+            {
+                const int begin = b * CSR_BLOCK;
+                const int end = begin + CSR_BLOCK < n ? begin + CSR_BLOCK : n;
+                wr = pb->csr(begin, end, rowstr, colidx, a, r, w, wr);
+                for (int j = begin; j < end; j++)
+                {
+                    rr = rr + r[j] * r[j];
+                }
+            }
+        }
+        partial[me][0] = rr;
+        partial[me][1] = wr;
+
+        for (int cgit = 1; cgit <= cgitmax; cgit++)
+        {
+            #pragma omp barrier
+            gamma = 0.0;
+            delta = 0.0;
+            for (int t = 0; t < nthreads; t++)
+            {
+                gamma = gamma + partial[t][0];
+                delta = delta + partial[t][1];
+            }
+
+            //---------------------------------------------------------------------
+            // Every thread sees the same gamma, so all leave together
+            // once ||r|| / ||r0|| is below the tolerance
+            //---------------------------------------------------------------------
+            if (cgit == 1)
+            {
+                gamma0 = gamma;
+            }
+            else if (gamma <= tol2 * gamma0)
+            {
+                used = cgit - 1;
+                break;
+            }
+
+            if (cgit == 1)
+            {
+                PHASE_END(T_CG_INIT, 8 * n8 + spmv_bytes(pb, format), nnz2 + 4.0 * n);
+            }
+            else
+            {
+                PHASE_END(T_CG_AXPY, 13 * n8, 16.0 * n);
+            }
+            PHASE_BEGIN(T_CG_SPMV);
+
+            //---------------------------------------------------------------------
+            // q = A.w
+            //---------------------------------------------------------------------
+            if (pb->format == SPMV_SELL)
+            {
+                #pragma omp for schedule(static)
+                for (int sl = 0; sl < pb->sell.nslices; sl++)
+                {
+                    pb->sell.kernel(&pb->sell, sl, w, q);
+                }
+            }
+            else
+            {
+                #pragma omp for schedule(static)
+                for (int b = 0; b < nblocks; b++)
+                {
+                    const int begin = b * CSR_BLOCK;
+                    const int end = begin + CSR_BLOCK < n ? begin + CSR_BLOCK : n;
+                    pb->csr(begin, end, rowstr, colidx, a, w, q, 0.0);
+                }
+            }
+            PHASE_END(T_CG_SPMV, spmv_bytes(pb, format), nnz2);
+            PHASE_BEGIN(T_CG_AXPY);
+
+            //---------------------------------------------------------------------
+            // alpha and beta from r.r and w.r alone
+            //---------------------------------------------------------------------
+            if (cgit == 1)
+            {
+                beta = 0.0;
+                alpha = gamma / delta;
+            }
+            else
+            {
+                beta = gamma / gamma_old;
+                alpha = gamma / (delta - beta * gamma / alpha);
+            }
+            gamma_old = gamma;
+
+            //---------------------------------------------------------------------
+            // u = q + beta*u, s = w + beta*s, p = r + beta*p
+            // z = z + alpha*p, r = r - alpha*s, w = w - alpha*u
+            // and the next r.r and w.r, in one sweep
+            //---------------------------------------------------------------------
+            rr = 0.0;
+            wr = 0.0;
+            #pragma omp for schedule(static) nowait
+            for (int j = 0; j < n; j++)
+            {
+                u[j] = q[j] + beta * u[j];
+                s[j] = w[j] + beta * s[j];
+                p[j] = r[j] + beta * p[j];
+                z[j] = z[j] + alpha * p[j];
+                r[j] = r[j] - alpha * s[j];
+                w[j] = w[j] - alpha * u[j];
+                rr = rr + r[j] * r[j];
+                wr = wr + w[j] * r[j];
+            }
+            partial[me][0] = rr;
+            partial[me][1] = wr;
+        } // end of do cgit=1,cgitmax
+
+        #pragma omp barrier
+        PHASE_END(T_CG_AXPY, 13 * n8, 16.0 * n);
 
         //---------------------------------------------------------------------
-        // Save a temporary of rho
+        // Compute residual norm explicitly:  ||r|| = ||x - A.z||
         //---------------------------------------------------------------------
-        rho0 = rho;
+        PHASE_BEGIN(T_CG_RESID);
+        residual_sum(pb, &sum);
+        PHASE_END(T_CG_RESID, spmv_bytes(pb, format) + n8, nnz2 + 3.0 * n);
+
+        #pragma omp master
+        iterations = used;
+    }
+
+    free(partial);
+    *rnorm = sqrt(sum);
+    return iterations;
+}
+
+//---------------------------------------------------------------------
+// Floaging point arrays here are named as in spec discussion of
+// CG algorithm
+//
+// Runs cgitmax steps, or fewer once sqrt(rho / rho0) drops below
+// pb->tolerance, and returns the number of steps taken.  With
+// pb->dinv set, rho is r.(D^-1 r): CG preconditioned by the diagonal.
+//---------------------------------------------------------------------
+int conj_grad(const cg_problem *pb, double *rnorm) {
+    if (pb->variant == CG_PIPELINED)
+        return conj_grad_pipelined(pb, rnorm);
+
+    const int cgitmax = 25;
+    const double tol2 = pb->tolerance * pb->tolerance;
+    const double *dinv = pb->dinv;
+    const int nrows = pb->na;
+    const int ncols = pb->na;
+    const int *colidx = pb->colidx;
+    const int *rowstr = pb->rowstr;
+    const double *a = pb->a;
+    const double *x = pb->x;
+    double *z = pb->z;
+    double *p = pb->p;
+    double *q = pb->q;
+    double *r = pb->r;
+
+    //---------------------------------------------------------------------
+    // Shared reduction targets.  The whole solve runs in one parallel
+    // region; each target is cleared by one thread in a phase where no
+    // thread reads it, and the barrier ending that phase publishes it.
+    //---------------------------------------------------------------------
+    double rho0 = 0.0;
+    double pq = 0.0;
+    double rr = 0.0;
+    double rt = 0.0;
+    double sum = 0.0;
+    int iterations = cgitmax;
+
+    const double n8 = sizeof(double) * (double)nrows;
+    const double nnz2 = 2.0 * pb->nnz;
+    const enum spmv_format resid_format = pb->format == SPMV_SELL ? SPMV_SELL : SPMV_CSR;
+
+    #pragma omp parallel
+    {
+        double rho, alpha, beta;
+        int used = cgitmax;
+        bool confirm = false;
 
         //---------------------------------------------------------------------
-        // Obtain z = z + alpha*p
-        // and    r = r - alpha*q
+        // Initialize the CG algorithm, and obtain rho = r.r in the same sweep
+        // (dj is 1 without preconditioning, which leaves every product exact)
         //---------------------------------------------------------------------
-        rho = 0.0;
-        for (int j = 0; j < lastcol - firstcol + 1; j++)
+        PHASE_BEGIN(T_CG_INIT);
+        #pragma omp for schedule(static) reduction(+:rho0)
+        for (int j = 0; j < nrows + 1; j++)
         {
-            z[j] = z[j] + alpha * p[j];
-            r[j] = r[j] - alpha * q[j];
+            double dj = dinv ? dinv[j] : 1.0;
+            q[j] = 0.0;
+            z[j] = 0.0;
+            r[j] = x[j];
+            p[j] = dj * r[j];
+            if (j < ncols)
+                rho0 = rho0 + r[j] * p[j];
         }
+        rho = rho0;
+        PHASE_END(T_CG_INIT, 5 * n8, 2.0 * nrows);
 
         //---------------------------------------------------------------------
-        // rho = r.r
-        // Now, obtain the norm of r: First, sum squares of r elements locally...
+        //---->
+        // The conj grad iteration loop
+        //---->
         //---------------------------------------------------------------------
-        for (int j = 0; j < lastcol - firstcol + 1; j++)
+        for (int cgit = 1; cgit <= cgitmax; cgit++)
         {
-            rho = rho + r[j] * r[j];
-        }
+            const bool restart = pb->format == SPMV_MIXED && (cgit % MIXED_RESTART == 0 || confirm);
+            PHASE_BEGIN(T_CG_SPMV);
 
-        //---------------------------------------------------------------------
-        // Obtain beta:
-        //---------------------------------------------------------------------
-        beta = rho / rho0;
+            //---------------------------------------------------------------------
+            // Mixed precision: replace r by the true residual x - A.z and
+            // restart the search direction from it
+            //---------------------------------------------------------------------
+            if (restart)
+            {
+                #pragma omp for schedule(static) reduction(+:rt)
+                for (int j = 0; j < nrows; j++)
+                {
+                    double d = 0.0;
+                    for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
+                    {
+                        d = d + a[k] * z[colidx[k]];
+                    }
+                    d = x[j] - d;
+                    r[j] = d;
+                    p[j] = (dinv ? dinv[j] : 1.0) * d;
+                    rt = rt + d * p[j];
+                }
+                rho = rt;
+
+                // the recurrence said converged: stop if the true residual agrees
+                if (confirm && fabs(rho) <= tol2 * fabs(rho0))
+                {
+                    PHASE_END(T_CG_SPMV, spmv_bytes(pb, SPMV_CSR) + 2 * n8, nnz2 + 3.0 * nrows);
+                    used = cgit - 1;
+                    break;
+                }
+                confirm = false;
+            }
+
+            //---------------------------------------------------------------------
+            // q = A.p, and p.q in the same sweep: the matrix is square
+            // (firstrow == firstcol), so row j of q pairs with p[j].
+            //---------------------------------------------------------------------
+            #pragma omp single nowait
+            rr = 0.0;
+
+            if (pb->format == SPMV_SELL)
+            {
+                #pragma omp for schedule(static) reduction(+:pq)
+                for (int s = 0; s < pb->sell.nslices; s++)
+                {
+                    pq = pq + pb->sell.kernel(&pb->sell, s, p, q);
+                }
+            }
+            else if (pb->format == SPMV_MIXED)
+            {
+                #pragma omp for schedule(static) reduction(+:pq)
+                for (int j = 0; j < nrows; j++)
+                {
+                    double qj = mixed_row(&pb->mixed, j, p);
+                    q[j] = qj;
+                    pq = pq + p[j] * qj;
+                }
+            }
+            else
+            {
+                #pragma omp for schedule(static) reduction(+:pq)
+                for (int b = 0; b < (nrows + CSR_BLOCK - 1) / CSR_BLOCK; b++)
+                {
+                    const int begin = b * CSR_BLOCK;
+                    const int end = begin + CSR_BLOCK < nrows ? begin + CSR_BLOCK : nrows;
+                    pq = pb->csr(begin, end, rowstr, colidx, a, p, q, pq);
+                }
+            }
+            PHASE_END(T_CG_SPMV,
+                      spmv_bytes(pb, pb->format) + (restart ? spmv_bytes(pb, SPMV_CSR) + 2 * n8 : 0.0),
+                      nnz2 + 2.0 * nrows + (restart ? nnz2 + 3.0 * nrows : 0.0));
+
+            //---------------------------------------------------------------------
+            // Obtain alpha = rho / (p.q)
+            //---------------------------------------------------------------------
+            PHASE_BEGIN(T_CG_AXPY);
+            alpha = rho / pq;
+
+            //---------------------------------------------------------------------
+            // Obtain z = z + alpha*p
+            // and    r = r - alpha*q
+            // and    rho = r.r in one sweep
+            //---------------------------------------------------------------------
+            #pragma omp for schedule(static) reduction(+:rr)
+            for (int j = 0; j < ncols; j++)
+            {
+                double dj = dinv ? dinv[j] : 1.0;
+                z[j] = z[j] + alpha * p[j];
+                r[j] = r[j] - alpha * q[j];
+                rr = rr + r[j] * (dj * r[j]);
+            }
+            PHASE_END(T_CG_AXPY, 6 * n8, 6.0 * ncols);
+
+            //---------------------------------------------------------------------
+            // Obtain beta:
+            //---------------------------------------------------------------------
+            beta = rr / rho;
+            rho = rr;
+
+            //---------------------------------------------------------------------
+            // rr is shared, so every thread takes the same exit.  The matrix
+            // is negative definite, so with D^-1 in it rho is negative.  The
+            // float recurrence of the mixed format drifts from the true
+            // residual, so there the next step checks it first.
+            //---------------------------------------------------------------------
+            if (fabs(rho) <= tol2 * fabs(rho0))
+            {
+                if (pb->format != SPMV_MIXED)
+                {
+                    used = cgit;
+                    break;
+                }
+                confirm = true;
+            }
+
+            //---------------------------------------------------------------------
+            // p = r + beta*p
+            //---------------------------------------------------------------------
+            PHASE_BEGIN(T_CG_PUPDATE);
+            #pragma omp single nowait
+            {
+                pq = 0.0;
+                rt = 0.0;
+            }
+
+            #pragma omp for schedule(static)
+            for (int j = 0; j < ncols; j++)
+            {
+                p[j] = (dinv ? dinv[j] : 1.0) * r[j] + beta * p[j];
+            }
+            PHASE_END(T_CG_PUPDATE, 3 * n8, 2.0 * ncols);
+        } // end of do cgit=1,cgitmax
 
         //---------------------------------------------------------------------
-        // p = r + beta*p
+        // Compute residual norm explicitly:  ||r|| = ||x - A.z||
         //---------------------------------------------------------------------
-        for (int j = 0; j < lastcol - firstcol + 1; j++)
-        {
-            p[j] = r[j] + beta * p[j];
-        }
-    } // end of do cgit=1,cgitmax
+        PHASE_BEGIN(T_CG_RESID);
+        residual_sum(pb, &sum);
+        PHASE_END(T_CG_RESID, spmv_bytes(pb, resid_format) + n8, nnz2 + 3.0 * nrows);
+
+        #pragma omp master
+        iterations = used;
+    }
+
+    *rnorm = sqrt(sum);
+    return iterations;
+}
+
+//---------------------------------------------------------------------
+// The randlc stream used by makea, produced in parallel blocks.
+//
+// randlc advances x -> amult * x (mod 2^46), so the state k draws ahead
+// is x * amult^k, computed in log2(k) steps.  Each block of DRAW_BLOCK
+// draws is split among the threads, and every thread jumps straight to
+// the start of its share; the draws are the same as serial randlc calls.
+//---------------------------------------------------------------------
+#define DRAW_BLOCK (1 << 18)
+
+static double *draws;
+static int draw_pos;
+static long draws_used;
+static double draw_seed;
+static double draw_block_seed;
+
+static double randlc_jump(double x, long k)
+{
+    double mult = amult;
+    while (k > 0)
+    {
+        if (k & 1)
+            randlc(&x, mult);
+        randlc(&mult, mult);
+        k >>= 1;
+    }
+    return x;
+}
+
+static void draw_refill(void)
+{
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int begin = (int)((long)DRAW_BLOCK * t / nt);
+        int end = (int)((long)DRAW_BLOCK * (t + 1) / nt);
+        double x = randlc_jump(draw_block_seed, begin);
+        vranlc(end - begin, &x, amult, draws + begin);
+    }
+    draw_block_seed = randlc_jump(draw_block_seed, DRAW_BLOCK);
+    draw_pos = 0;
+}
+
+static void draw_start(double seed)
+{
+    draws = malloc(sizeof(double) * DRAW_BLOCK);
+    if (draws == NULL)
+    {
+        printf("Out of memory in makea\n");
+        exit(EXIT_FAILURE);
+    }
+    draw_seed = seed;
+    draw_block_seed = seed;
+    draw_pos = DRAW_BLOCK;
+    draws_used = 0;
+}
+
+// the next value randlc(&tran, amult) would have returned
+static double next_draw(void)
+{
+    if (draw_pos == DRAW_BLOCK)
+        draw_refill();
+    draws_used++;
+    return draws[draw_pos++];
+}
+
+// release the buffer and return the stream state after the draws used
+static double draw_finish(void)
+{
+    free(draws);
+    draws = NULL;
+    return randlc_jump(draw_seed, draws_used);
+}
+
+//---------------------------------------------------------------------
+// the first half of makea: draw the n sparse vectors whose outer
+// products sparse() sums into the matrix
+//---------------------------------------------------------------------
+static void make_vectors(int n, int nonzer, int arow[], int acol[][nonzer + 1], double aelt[][nonzer + 1])
+{
+    int nzv, nn1;
+    int ivc[nonzer + 1];
+    double vc[nonzer + 1];
 
     //---------------------------------------------------------------------
-    // Compute residual norm explicitly:  ||r|| = ||x - A.z||
-    // First, form A.z
-    // The partition submatrix-vector multiply
+    // nonzer is approximately  (int(sqrt(nnza /n)));
+    //---------------------------------------------------------------------
+
+    //---------------------------------------------------------------------
+    // nn1 is the smallest power of two not less than n
     //---------------------------------------------------------------------
-    sum = 0.0;
-    for (int j = 0; j < lastrow - firstrow + 1; j++)
+    nn1 = 1;
+    do
     {
-        d = 0.0;
-        for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
-        {
-            d = d + a[k] * z[colidx[k]];
-        }
-        r[j] = d;
-    }
+        nn1 = 2 * nn1;
+    } while (nn1 < n);
 
     //---------------------------------------------------------------------
-    // At this point, r contains A.z
+    // Generate nonzero positions and save for the use in sparse.
+    // sprnvc rejects draws, so a row's place in the random stream depends
+    // on every row before it; rows are consumed in order while the draws
+    // themselves are produced in parallel blocks (see next_draw).
     //---------------------------------------------------------------------
-    for (int j = 0; j < lastcol - firstcol + 1; j++)
+    draw_start(tran);
+    for (int iouter = 0; iouter < n; iouter++)
     {
-        d = x[j] - r[j];
-        sum = sum + d * d;
-    }
+        nzv = nonzer;
+        sprnvc(n, nzv, nn1, vc, ivc);
+        vecset(n, vc, ivc, &nzv, iouter + 1, 0.5);
 
-    *rnorm = sqrt(sum);
+        arow[iouter] = nzv;
+
+        for (int ivelt = 0; ivelt < nzv; ivelt++)
+        {
+            acol[iouter][ivelt] = ivc[ivelt] - 1;
+            aelt[iouter][ivelt] = vc[ivelt];
+        }
+    }
+    tran = draw_finish();
 }
 
 //---------------------------------------------------------------------
@@ -160,6 +794,7 @@ void conj_grad(const int colidx[], const int rowstr[], const double x[], double
 //
 // n            i           number of cols/rows of matrix
 // nz           i           nonzeros as declared array size
+// nonzer       i           nonzeros per generated vector
 // rcond        r*8         condition number
 // shift        r*8         main diagonal shift
 //
@@ -176,6 +811,7 @@ void conj_grad(const int colidx[], const int rowstr[], const double x[], double
 //---------------------------------------------------------------------
 void makea(int n,
            int nz,
+           int nonzer,
            double a[],
            int colidx[],
            int rowstr[],
@@ -184,54 +820,18 @@ void makea(int n,
            int firstcol,
            int lastcol,
            int arow[],
-           int acol[][NONZER + 1],
-           double aelt[][NONZER + 1],
-           int iv[]){
-    int nzv, nn1;
-    int ivc[NONZER + 1];
-    double vc[NONZER + 1];
-
-    //---------------------------------------------------------------------
-    // nonzer is approximately  (int(sqrt(nnza /n)));
-    //---------------------------------------------------------------------
-
-    //---------------------------------------------------------------------
-    // nn1 is the smallest power of two not less than n
-    //---------------------------------------------------------------------
-    nn1 = 1;
-    do
-    {
-        nn1 = 2 * nn1;
-    } while (nn1 < n);
+           int acol[][nonzer + 1],
+           double aelt[][nonzer + 1],
+           int iv[],
+           double rcond,
+           double shift){
+    make_vectors(n, nonzer, arow, acol, aelt);
 
-    //---------------------------------------------------------------------
-    // Generate nonzero positions and save for the use in sparse.
-    //---------------------------------------------------------------------
-    // #pragma omp parallel for default(shared) private(nzv)
-    for (int iouter = 0; iouter < n; iouter++)
-    {
-        nzv = NONZER;
-        // #pragma omp ordered
-        // {
-            sprnvc(n, nzv, nn1, vc, ivc);
-            vecset(n, vc, ivc, &nzv, iouter + 1, 0.5);
-        // }
-        
-        arow[iouter] = nzv;
-
-        // #pragma omp parallel for firstprivate(nzv, iouter)
-        for (int ivelt = 0; ivelt < nzv; ivelt++)
-        {
-            acol[iouter][ivelt] = ivc[ivelt] - 1;
-            aelt[iouter][ivelt] = vc[ivelt];
-        }
-    }
-    // #pragma omp barrier
     //---------------------------------------------------------------------
     // ... make the sparse matrix from list of elements with duplicates
     //     (iv is used as  workspace)
     //---------------------------------------------------------------------
-    sparse(a, colidx, rowstr, n, nz, NONZER, arow, acol, aelt, firstrow, lastrow, iv, RCOND, SHIFT);
+    sparse(a, colidx, rowstr, n, nz, nonzer, arow, acol, aelt, firstrow, lastrow, iv, rcond, shift);
 }
 
 //---------------------------------------------------------------------
@@ -245,8 +845,8 @@ void sparse(double a[],
             int nz,
             int nozer,
             const int arow[],
-            int acol[][NONZER + 1],
-            double aelt[][NONZER + 1],
+            int acol[][nozer + 1],
+            double aelt[][nozer + 1],
             int firstrow,
             int lastrow,
             int nzloc[],
@@ -255,41 +855,107 @@ void sparse(double a[],
     //---------------------------------------------------
     // generate a sparse matrix from a list of
     // [col, row, element] tri
+    //
+    // Row j collects the outer products of every vector i with j in
+    // acol[i].  Rows are built independently, each adding its
+    // contributions in increasing i exactly as the serial sweep over i
+    // did, so the result is bit-identical for any thread count.
     //---------------------------------------------------
-    int nza, nzrow, jcol;
-    double size, scale, ratio, va;
-    bool cont40;
-
-    //---------------------------------------------------------------------
-    // how many rows of result
-    //---------------------------------------------------------------------
     const int nrows = lastrow - firstrow + 1;
+    const int nthreads = omp_get_max_threads();
+    double ratio = pow(rcond, (1.0 / (double)(n)));
+
+    int *contrib_start = malloc(sizeof(int) * (nrows + 1));
+    int *contrib = malloc(sizeof(int) * n * (nozer + 1));
+    int *offset = calloc((size_t)nthreads * nrows, sizeof(int));
+    double *size = malloc(sizeof(double) * n);
+    if (contrib_start == NULL || contrib == NULL || offset == NULL || size == NULL)
+    {
+        printf("Out of memory in sparse\n");
+        exit(EXIT_FAILURE);
+    }
 
     //---------------------------------------------------------------------
-    // ...count the number of triples in each row
+    // vector i is scaled by ratio^i, accumulated as the serial loop did
     //---------------------------------------------------------------------
-    for (int j = 0; j < nrows + 1; j++)
+    size[0] = 1.0;
+    for (int i = 1; i < n; i++)
     {
-        rowstr[j] = 0;
+        size[i] = size[i - 1] * ratio;
     }
 
-    #pragma omp parallel for private(nza)
-    for (int i = 0; i < n; i++)
+    //---------------------------------------------------------------------
+    // ...list the vectors contributing to each row, in increasing i:
+    //    per-thread histograms over static blocks of i, then each thread
+    //    scatters its block to its own offsets
+    //---------------------------------------------------------------------
+    #pragma omp parallel num_threads(nthreads)
     {
-        for (nza = 0; nza < arow[i]; nza++)
+        int *mine = offset + (size_t)omp_get_thread_num() * nrows;
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            for (int nza = 0; nza < arow[i]; nza++)
+            {
+                mine[acol[i][nza]]++;
+            }
+        }
+
+        #pragma omp for schedule(static)
+        for (int j = 0; j < nrows; j++)
+        {
+            int total = 0;
+            for (int t = 0; t < omp_get_num_threads(); t++)
+            {
+                int count = offset[(size_t)t * nrows + j];
+                offset[(size_t)t * nrows + j] = total;
+                total += count;
+            }
+            contrib_start[j + 1] = total;
+        }
+
+        #pragma omp single
+        {
+            contrib_start[0] = 0;
+            for (int j = 0; j < nrows; j++)
+            {
+                contrib_start[j + 1] += contrib_start[j];
+            }
+        }
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++)
         {
-            int j = acol[i][nza] + 1;
-            #pragma omp atomic
-            rowstr[j] = rowstr[j] + arow[i];
+            for (int nza = 0; nza < arow[i]; nza++)
+            {
+                int j = acol[i][nza];
+                contrib[contrib_start[j] + mine[j]++] = i * (nozer + 1) + nza;
+            }
+        }
+
+        //---------------------------------------------------------------------
+        // ...count the number of triples in each row
+        //---------------------------------------------------------------------
+        #pragma omp for schedule(static)
+        for (int j = 0; j < nrows; j++)
+        {
+            int count = 0;
+            for (int c = contrib_start[j]; c < contrib_start[j + 1]; c++)
+            {
+                count += arow[contrib[c] / (nozer + 1)];
+            }
+            rowstr[j + 1] = count;
         }
     }
+    free(offset);
 
     rowstr[0] = 0;
     for (int j = 1; j < nrows + 1; j++)
     {
         rowstr[j] = rowstr[j] + rowstr[j - 1];
     }
-    nza = rowstr[nrows] - 1;
+    int nza = rowstr[nrows] - 1;
 
     //---------------------------------------------------------------------
     // ... rowstr(j) now is the location of the first nonzero
@@ -303,35 +969,33 @@ void sparse(double a[],
     }
 
     //---------------------------------------------------------------------
-    // ... preload data pages
+    // ... generate actual values by summing duplicates; each row is
+    //     kept sorted in its own scratch slot [rowstr(j), rowstr(j+1))
+    //     and nzloc(j) counts its distinct columns
     //---------------------------------------------------------------------
-    for (int j = 0; j < nrows; j++)
+    int *slot_col = malloc(sizeof(int) * rowstr[nrows]);
+    double *slot_a = malloc(sizeof(double) * rowstr[nrows]);
+    if (slot_col == NULL || slot_a == NULL)
     {
-        for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
-        {
-            a[k] = 0.0;
-            colidx[k] = -1;
-        }
-        nzloc[j] = 0;
+        printf("Out of memory in sparse\n");
+        exit(EXIT_FAILURE);
     }
 
-    //---------------------------------------------------------------------
-    // ... generate actual values by summing duplicates
-    //---------------------------------------------------------------------
-    size = 1.0;
-    ratio = pow(rcond, (1.0 / (double)(n)));
-
-    for (int i = 0; i < n; i++)
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int j = 0; j < nrows; j++)
     {
-        for (nza = 0; nza < arow[i]; nza++)
-        {
-            int j = acol[i][nza];
+        int *cols = slot_col + rowstr[j];
+        double *vals = slot_a + rowstr[j];
+        int len = 0;
 
-            scale = size * aelt[i][nza];
-            for (nzrow = 0; nzrow < arow[i]; nzrow++)
+        for (int c = contrib_start[j]; c < contrib_start[j + 1]; c++)
+        {
+            int i = contrib[c] / (nozer + 1);
+            double scale = size[i] * aelt[i][contrib[c] % (nozer + 1)];
+            for (int nzrow = 0; nzrow < arow[i]; nzrow++)
             {
                 int jcol = acol[i][nzrow];
-                va = aelt[i][nzrow] * scale;
+                double va = aelt[i][nzrow] * scale;
 
                 //--------------------------------------------------------------------
                 // ... add the identity * rcond to the generated matrix to bound
@@ -342,87 +1006,64 @@ void sparse(double a[],
                     va = va + rcond - shift;
                 }
 
-                cont40 = false;
-                int k = rowstr[j];
-                for (; k < rowstr[j + 1]; k++)
+                //--------------------------------------------------------------------
+                // ... insert colidx here orderly, or add to the duplicated entry
+                //--------------------------------------------------------------------
+                int k = len;
+                while (k > 0 && cols[k - 1] > jcol)
                 {
-                    if (colidx[k] > jcol)
-                    {
-                        //----------------------------------------------------------------
-                        // ... insert colidx here orderly
-                        //----------------------------------------------------------------
-                        for (int kk = rowstr[j + 1] - 2; kk >= k; kk--)
-                        {
-                            if (colidx[kk] > -1)
-                            {
-                                a[kk + 1] = a[kk];
-                                colidx[kk + 1] = colidx[kk];
-                            }
-                        }
-                        colidx[k] = jcol;
-                        a[k] = 0.0;
-                        cont40 = true;
-                        break;
-                    }
-                    if (colidx[k] == -1)
-                    {
-                        colidx[k] = jcol;
-                        cont40 = true;
-                        break;
-                    }
-                    if (colidx[k] == jcol)
-                    {
-                        //--------------------------------------------------------------
-                        // ... mark the duplicated entry
-                        //--------------------------------------------------------------
-                        nzloc[j] = nzloc[j] + 1;
-                        cont40 = true;
-                        break;
-                    }
+                    k--;
                 }
-                if (cont40 == false)
+                if (k > 0 && cols[k - 1] == jcol)
                 {
-                    printf("internal error in sparse: i=%d\n", i);
-                    exit(EXIT_FAILURE);
+                    vals[k - 1] = vals[k - 1] + va;
+                    continue;
                 }
-                a[k] = a[k] + va;
+                for (int kk = len; kk > k; kk--)
+                {
+                    cols[kk] = cols[kk - 1];
+                    vals[kk] = vals[kk - 1];
+                }
+                cols[k] = jcol;
+                vals[k] = 0.0 + va;
+                len++;
             }
         }
-        size = size * ratio;
+        nzloc[j] = len;
     }
+    free(contrib_start);
+    free(contrib);
+    free(size);
 
     //---------------------------------------------------------------------
-    // ... remove empty entries and generate final results
+    // ... remove empty entries and generate final results.  This pass is
+    //     the first to touch a and colidx, and it uses the static row
+    //     schedule of the SpMV in conj_grad, so each thread's rows land
+    //     on its own NUMA node.
     //---------------------------------------------------------------------
     for (int j = 1; j < nrows; j++)
     {
         nzloc[j] = nzloc[j] + nzloc[j - 1];
     }
 
+    #pragma omp parallel for schedule(static)
     for (int j = 0; j < nrows; j++)
     {
-        int j1 = 0;
-        if (j > 0)
-        {
-            j1 = rowstr[j] - nzloc[j - 1];
-        }
-        else
+        int dst = j > 0 ? nzloc[j - 1] : 0;
+        for (int k = rowstr[j]; dst < nzloc[j]; k++, dst++)
         {
-            j1 = 0;
-        }
-        int j2 = rowstr[j + 1] - nzloc[j];
-        nza = rowstr[j];
-        for (int k = j1; k < j2; k++)
-        {
-            a[k] = a[nza];
-            colidx[k] = colidx[nza];
-            nza = nza + 1;
+            colidx[dst] = slot_col[k];
+            a[dst] = slot_a[k];
         }
     }
+
+    rowstr[0] = 0;
     for (int j = 1; j < nrows + 1; j++)
     {
-        rowstr[j] = rowstr[j] - nzloc[j - 1];
+        rowstr[j] = nzloc[j - 1];
     }
+    free(slot_col);
+    free(slot_a);
 }
 
 //---------------------------------------------------------------------
@@ -441,17 +1082,11 @@ void sprnvc(int n, int nz, int nn1, double v[], int iv[]){
 
     while (nzv < nz)
     {
-        #pragma omp critical(randlc)
-        {
-            vecelt = randlc(&tran, amult);
-        }
+        vecelt = next_draw();
         //---------------------------------------------------------------------
         // generate an integer between 1 and n in a portable manner
         //---------------------------------------------------------------------
-        #pragma omp critical(randlc)
-        {
-            vecloc = randlc(&tran, amult);
-        }
+        vecloc = next_draw();
 
         int i = icnvrt(vecloc, nn1) + 1;
         if (i > n)
@@ -506,14 +1141,228 @@ void vecset(int n, double v[], int iv[], int *nzv, int i, double val){
     }
 }
 
-void init(double *zeta){
+//---------------------------------------------------------------------
+// Mean time of one double CSR SpMV q = A.p with the given kernel, with
+// p set to all ones.
+//---------------------------------------------------------------------
+static double csr_spmv_seconds(const cg_problem *pb, csr_kernel kernel, int reps)
+{
+    const int nrows = pb->na;
+    const int *colidx = pb->colidx;
+    const int *rowstr = pb->rowstr;
+    const double *a = pb->a;
+    double *p = pb->p;
+    double *q = pb->q;
+    double t;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < nrows; i++)
+    {
+        p[i] = 1.0;
+    }
+
+    t = -omp_get_wtime();
+    for (int rep = 0; rep < reps; rep++)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int b = 0; b < (nrows + CSR_BLOCK - 1) / CSR_BLOCK; b++)
+        {
+            const int begin = b * CSR_BLOCK;
+            const int end = begin + CSR_BLOCK < nrows ? begin + CSR_BLOCK : nrows;
+            kernel(begin, end, rowstr, colidx, a, p, q, 0.0);
+        }
+    }
+    return (t + omp_get_wtime()) / reps;
+}
+
+//---------------------------------------------------------------------
+// Time every CSR kernel on this matrix and return the fastest.  Each
+// kernel is judged by its best of a few products after an untimed one,
+// which filters out interference better than the mean.
+//---------------------------------------------------------------------
+static csr_kernel tune_csr_kernel(const cg_problem *pb)
+{
+    const int reps = 8;
+    const double bytes = spmv_bytes(pb, SPMV_CSR);
+    int best = 0;
+    double best_t = 0.0;
+
+    printf(" SpMV kernel autotune (best of %d products):\n", reps);
+    for (int i = 0; i < csr_kernel_count; i++)
+    {
+        double t = csr_spmv_seconds(pb, csr_kernels[i].kernel, 1);
+        t = csr_spmv_seconds(pb, csr_kernels[i].kernel, 1);
+        for (int rep = 1; rep < reps; rep++)
+        {
+            double t_rep = csr_spmv_seconds(pb, csr_kernels[i].kernel, 1);
+            if (t_rep < t)
+                t = t_rep;
+        }
+        printf("   %-9s %8.3f ms %7.2f GB/s\n", csr_kernels[i].name, t * 1e3, bytes / t / 1e9);
+        if (i == 0 || t < best_t)
+        {
+            best = i;
+            best_t = t;
+        }
+    }
+    printf("   selected %s\n", csr_kernels[best].name);
+    return csr_kernels[best].kernel;
+}
+
+//---------------------------------------------------------------------
+// Time a few SpMVs with the double CSR matrix and the mixed-precision
+// copy, and report the bytes each one streams per product.
+//---------------------------------------------------------------------
+static void report_mixed_bandwidth(const cg_problem *pb)
+{
+    const int nrows = pb->na;
+    const int *rowstr = pb->rowstr;
+    const double *p = pb->p;
+    double *q = pb->q;
+    const int reps = 10;
+    const double csr_bytes = (double)rowstr[nrows] * (sizeof(double) + sizeof(int))
+                             + (nrows + 1) * sizeof(int) + 2.0 * nrows * sizeof(double);
+    const double mixed_bytes = (double)pb->mixed.nnz * (sizeof(float) + sizeof(unsigned short))
+                               + (2 * nrows + 1) * sizeof(int) + 2.0 * nrows * sizeof(double);
+    double t_csr, t_mixed;
+
+    t_csr = csr_spmv_seconds(pb, pb->csr, reps);
+
+    t_mixed = -omp_get_wtime();
+    for (int rep = 0; rep < reps; rep++)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int j = 0; j < nrows; j++)
+        {
+            q[j] = mixed_row(&pb->mixed, j, p);
+        }
+    }
+    t_mixed = (t_mixed + omp_get_wtime()) / reps;
+
+    printf(" SpMV format: mixed (float values, 16-bit column deltas, %ld fillers)\n", pb->mixed.nfill);
+    printf("   csr   %8.2f MB/SpMV %8.3f ms %7.2f GB/s\n", csr_bytes / 1e6, t_csr * 1e3,
+           csr_bytes / t_csr / 1e9);
+    printf("   mixed %8.2f MB/SpMV %8.3f ms %7.2f GB/s\n", mixed_bytes / 1e6, t_mixed * 1e3,
+           mixed_bytes / t_mixed / 1e9);
+    printf("   saved %8.2f MB/SpMV (%.1f%%), %.2fx faster\n", (csr_bytes - mixed_bytes) / 1e6,
+           100.0 * (csr_bytes - mixed_bytes) / csr_bytes, t_csr / t_mixed);
+}
+
+//---------------------------------------------------------------------
+// Renumber rows and columns in reverse Cuthill-McKee order, reporting
+// the bandwidth and the CSR SpMV time before and after.
+//---------------------------------------------------------------------
+static void reorder_matrix(cg_problem *pb)
+{
+    const int n = pb->na;
+    const int reps = 10;
+    int *perm = malloc(sizeof(int) * n);
+    if (perm == NULL)
+    {
+        printf("Out of memory in reorder_matrix\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int bw_before = matrix_bandwidth(n, pb->rowstr, pb->colidx);
+    double t_before = csr_spmv_seconds(pb, csr_kernels[0].kernel, reps);
+    double t_order = -omp_get_wtime();
+    rcm_order(n, pb->rowstr, pb->colidx, perm);
+    permute_matrix(n, pb->rowstr, pb->colidx, pb->a, perm);
+    t_order += omp_get_wtime();
+    int bw_after = matrix_bandwidth(n, pb->rowstr, pb->colidx);
+    double t_after = csr_spmv_seconds(pb, csr_kernels[0].kernel, reps);
+    free(perm);
+
+    printf(" Reordering: RCM in %.3f s\n", t_order);
+    printf("   bandwidth %9d -> %9d\n", bw_before, bw_after);
+    printf("   CSR SpMV  %9.3f -> %9.3f ms (%.2fx)\n", t_before * 1e3, t_after * 1e3,
+           t_before / t_after);
+}
+
+//---------------------------------------------------------------------
+// Describe the compile-time class: its sizes and the static arrays
+// declared in cg_impl.h.
+//---------------------------------------------------------------------
+void problem_class(cg_problem *pb)
+{
+    memset(pb, 0, sizeof(*pb));
+    pb->na = NA;
+    pb->nonzer = NONZER;
+    pb->shift = SHIFT;
+    pb->rcond = RCOND;
+    pb->owned = false;
+    pb->rowstr = rowstr;
+    pb->colidx = colidx;
+    pb->a = a;
+    pb->x = x;
+    pb->z = z;
+    pb->p = p;
+    pb->q = q;
+    pb->r = r;
+}
+
+//---------------------------------------------------------------------
+// A problem of any size on the heap.  The vectors are allocated here;
+// the matrix is allocated by problem_init once its size is known.
+//---------------------------------------------------------------------
+bool problem_create(cg_problem *pb, int na, int nonzer, double shift)
+{
+    memset(pb, 0, sizeof(*pb));
+    if (na < 2 || nonzer < 1 || nonzer >= na)
+        return false;
+
+    pb->na = na;
+    pb->nonzer = nonzer;
+    pb->shift = shift;
+    pb->rcond = RCOND;
+    pb->owned = true;
+    pb->rowstr = malloc(sizeof(int) * (na + 1));
+    pb->x = malloc(sizeof(double) * (na + 2));
+    pb->z = malloc(sizeof(double) * (na + 2));
+    pb->p = malloc(sizeof(double) * (na + 2));
+    pb->q = malloc(sizeof(double) * (na + 2));
+    pb->r = malloc(sizeof(double) * (na + 2));
+    if (pb->rowstr == NULL || pb->x == NULL || pb->z == NULL || pb->p == NULL || pb->q == NULL
+        || pb->r == NULL)
+    {
+        problem_free(pb);
+        return false;
+    }
+    return true;
+}
+
+void problem_free(cg_problem *pb)
+{
+    sell_free(&pb->sell);
+    mixed_free(&pb->mixed);
+    free(pb->w);
+    free(pb->s);
+    free(pb->u);
+    free(pb->dinv);
+    if (pb->owned)
+    {
+        free(pb->rowstr);
+        free(pb->colidx);
+        free(pb->a);
+        free(pb->x);
+        free(pb->z);
+        free(pb->p);
+        free(pb->q);
+        free(pb->r);
+    }
+    memset(pb, 0, sizeof(*pb));
+}
+
+void problem_init(cg_problem *pb, double *zeta){
+    const int n = pb->na;
+    const int nonzer = pb->nonzer;
+
     firstrow = 0;
-    lastrow = NA - 1;
+    lastrow = n - 1;
     firstcol = 0;
-    lastcol = NA - 1;
+    lastcol = n - 1;
 
-    naa = NA;
-    nzz = NZ;
+    naa = n;
 
     //---------------------------------------------------------------------
     // Inialize random number generator
@@ -523,10 +1372,77 @@ void init(double *zeta){
     *zeta = randlc(&tran, amult);
 
     //---------------------------------------------------------------------
-    //
+    // makea, with its workspace on the heap for the duration of the call
+    //---------------------------------------------------------------------
+    int *work_arow = malloc(sizeof(int) * n);
+    int (*work_acol)[nonzer + 1] = malloc(sizeof(int) * n * (nonzer + 1));
+    double (*work_aelt)[nonzer + 1] = malloc(sizeof(double) * n * (nonzer + 1));
+    int *work_iv = malloc(sizeof(int) * n);
+    if (work_arow == NULL || work_acol == NULL || work_aelt == NULL || work_iv == NULL)
+    {
+        printf("Out of memory in makea\n");
+        exit(EXIT_FAILURE);
+    }
+
+    make_vectors(n, nonzer, work_arow, work_acol, work_aelt);
+
+    //---------------------------------------------------------------------
+    // A heap problem sizes the matrix from the triples actually drawn
+    // (sum of arow^2, duplicates included) and trims it to the nonzeros
+    // left once sparse has merged them.
+    //---------------------------------------------------------------------
+    if (pb->owned)
+    {
+        long bound = 0;
+        for (int i = 0; i < n; i++)
+        {
+            bound += (long)work_arow[i] * work_arow[i];
+        }
+        free(pb->a);
+        free(pb->colidx);
+        pb->a = malloc(sizeof(double) * bound);
+        pb->colidx = malloc(sizeof(int) * bound);
+        if (pb->a == NULL || pb->colidx == NULL || bound > INT_MAX)
+        {
+            printf("Cannot allocate %ld matrix elements\n", bound);
+            exit(EXIT_FAILURE);
+        }
+        nzz = (int)bound;
+    }
+    else
+    {
+        nzz = NZ;
+    }
+
+    sparse(pb->a, pb->colidx, pb->rowstr, n, nzz, nonzer, work_arow, work_acol, work_aelt, firstrow,
+           lastrow, work_iv, pb->rcond, pb->shift);
+    pb->nnz = pb->rowstr[n];
+    free(work_arow);
+    free(work_acol);
+    free(work_aelt);
+    free(work_iv);
+
+    //---------------------------------------------------------------------
+    // Give back the unused tail of the heap matrix.  This only shrinks,
+    // so if realloc fails the original block is still good to keep.
     //---------------------------------------------------------------------
-    makea(naa, nzz, a, colidx, rowstr, firstrow, lastrow, firstcol, lastcol, arow,
-          (int(*)[NONZER + 1]) acol, (double(*)[NONZER + 1]) aelt, iv);
+    if (pb->owned)
+    {
+        double *a_fit = realloc(pb->a, sizeof(double) * pb->nnz);
+        int *colidx_fit = realloc(pb->colidx, sizeof(int) * pb->nnz);
+        if (a_fit != NULL)
+            pb->a = a_fit;
+        if (colidx_fit != NULL)
+            pb->colidx = colidx_fit;
+    }
+
+    const int *rowstr = pb->rowstr;
+    int *colidx = pb->colidx;
+    double *x = pb->x;
+    double *z = pb->z;
+    double *p = pb->p;
+    double *q = pb->q;
+    double *r = pb->r;
 
     //---------------------------------------------------------------------
     // Note: as a result of the above call to makea:
@@ -536,37 +1452,132 @@ void init(double *zeta){
     //      Shift the col index vals from actual (firstcol --> lastcol )
     //      to local, i.e., (0 --> lastcol-firstcol)
     //---------------------------------------------------------------------
-    // #pragma omp parallel for default(shared) schedule(static)
+    #pragma omp parallel for default(shared) schedule(static)
     for (int j = 0; j < lastrow - firstrow + 1; j++) {
         for (int k = rowstr[j]; k < rowstr[j + 1]; k++) {
             colidx[k] -= firstcol;
         }
     }
-     
 
     //---------------------------------------------------------------------
-    // set starting vector to (1, 1, .... 1)
+    // set starting vector to (1, 1, .... 1).  This is also the first touch
+    // of the vectors, done with the static schedule of conj_grad's loops.
     //---------------------------------------------------------------------
-    // #pragma omp parallel for
-    for (int i = 0; i < NA + 1; i++)
-    {
-        x[i] = 1.0;
-    }
-    // #pragma omp parallel for
-    for (int j = 0; j < lastcol - firstcol + 1; j++)
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < n + 1; j++)
     {
+        x[j] = 1.0;
         q[j] = 0.0;
         z[j] = 0.0;
         r[j] = 0.0;
         p[j] = 0.0;
     }
+
+    //---------------------------------------------------------------------
+    // Optional locality reordering.  x is all ones and the other vectors
+    // are zero, so they are already in any row order.
+    //---------------------------------------------------------------------
+    if (reorder_rcm)
+        reorder_matrix(pb);
+
+    //---------------------------------------------------------------------
+    // CSR SpMV kernel, picked by timing them all if asked to
+    //---------------------------------------------------------------------
+    if (csr_choice < 0)
+        pb->csr = tune_csr_kernel(pb);
+    else
+        pb->csr = csr_kernels[csr_choice].kernel;
+
+    //---------------------------------------------------------------------
+    // Pipelined CG keeps three more vectors, first touched by conj_grad
+    //---------------------------------------------------------------------
+    pb->variant = cg_variant;
+    free(pb->w);
+    free(pb->s);
+    free(pb->u);
+    pb->w = pb->s = pb->u = NULL;
+    if (pb->variant == CG_PIPELINED)
+    {
+        pb->w = malloc(sizeof(double) * (n + 2));
+        pb->s = malloc(sizeof(double) * (n + 2));
+        pb->u = malloc(sizeof(double) * (n + 2));
+        if (pb->w == NULL || pb->s == NULL || pb->u == NULL)
+        {
+            printf("Out of memory allocating pipelined CG vectors\n");
+            exit(EXIT_FAILURE);
+        }
+        printf(" CG variant: pipelined, one reduction per step\n");
+    }
+
+    //---------------------------------------------------------------------
+    // Early exit and Jacobi preconditioning (classic CG only); every row
+    // holds its diagonal, which the shift keeps well below zero
+    //---------------------------------------------------------------------
+    pb->tolerance = cg_tolerance;
+    free(pb->dinv);
+    pb->dinv = NULL;
+    if (cg_jacobi && pb->variant == CG_CLASSIC)
+    {
+        pb->dinv = malloc(sizeof(double) * (n + 2));
+        if (pb->dinv == NULL)
+        {
+            printf("Out of memory allocating the Jacobi preconditioner\n");
+            exit(EXIT_FAILURE);
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int j = 0; j < n + 2; j++)
+        {
+            pb->dinv[j] = 1.0;
+            if (j < n)
+            {
+                for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
+                {
+                    if (colidx[k] == j)
+                        pb->dinv[j] = 1.0 / pb->a[k];
+                }
+            }
+        }
+        printf(" Preconditioner: Jacobi\n");
+    }
+    if (pb->tolerance > 0.0)
+        printf(" CG tolerance: %.1e relative residual\n", pb->tolerance);
+
+    //---------------------------------------------------------------------
+    // Repack the matrix for the SIMD SpMV if requested
+    //---------------------------------------------------------------------
+    pb->format = spmv_format;
+    sell_free(&pb->sell);
+    mixed_free(&pb->mixed);
+    if (pb->format == SPMV_SELL)
+    {
+        sell_build(&pb->sell, n, rowstr, colidx, pb->a);
+        printf(" SpMV format: SELL-%d-%d (%s), %.1f%% of stored entries are nonzeros\n",
+               SELL_C, SELL_SIGMA, sell_isa(),
+               100.0 * pb->sell.nnz / pb->sell.slice_ptr[pb->sell.nslices]);
+    }
+
+    if (pb->format == SPMV_MIXED)
+    {
+        mixed_build(&pb->mixed, n, rowstr, colidx, pb->a);
+        report_mixed_bandwidth(pb);
+    }
+
 }
 
-void iterate(double *zeta, const int *it){
+void problem_iterate(cg_problem *pb, double *zeta, const int *it){
+    const int n = pb->na;
+    const double *z = pb->z;
+    double *x = pb->x;
     double rnorm;
     double norm_temp1, norm_temp2;
+    int cg_steps;
 
-    conj_grad(colidx, rowstr, x, z, a, p, q, r, &rnorm);
+    if (timeron)
+        timer_start(T_CONJ_GRAD);
+    cg_steps = conj_grad(pb, &rnorm);
+    if (timeron)
+        timer_stop(T_CONJ_GRAD);
 
     //---------------------------------------------------------------------
     // zeta = shift + 1/(x.z)
@@ -574,28 +1585,377 @@ void iterate(double *zeta, const int *it){
     // Also, find norm of z
     // So, first: (z.z)
     //---------------------------------------------------------------------
+    if (timeron)
+        timer_start(T_IT_NORM);
     norm_temp1 = 0.0;
     norm_temp2 = 0.0;
-    #pragma omp parallel for reduction(+:norm_temp1, norm_temp2)
-    for (int j = 0; j < lastcol - firstcol + 1; j++)
+    #pragma omp parallel for schedule(static) reduction(+:norm_temp1, norm_temp2)
+    for (int j = 0; j < n; j++)
     {
         norm_temp1 = norm_temp1 + x[j] * z[j];
         norm_temp2 = norm_temp2 + z[j] * z[j];
     }
+    if (timeron)
+        phase_end(T_IT_NORM, 2.0 * sizeof(double) * n, 4.0 * n);
 
     norm_temp2 = 1.0 / sqrt(norm_temp2);
 
-    *zeta = SHIFT + 1.0 / norm_temp1;
-    if (*it == 1)
-        printf("\n   iteration           ||r||                 zeta\n");
-    printf("    %5d       %20.14E%20.13f\n", *it, rnorm, *zeta);
+    *zeta = pb->shift + 1.0 / norm_temp1;
+    if (pb->tolerance > 0.0 || pb->dinv != NULL)
+    {
+        if (*it == 1)
+            printf("\n   iteration           ||r||                 zeta  cg steps\n");
+        printf("    %5d       %20.14E%20.13f %9d\n", *it, rnorm, *zeta, cg_steps);
+    }
+    else
+    {
+        if (*it == 1)
+            printf("\n   iteration           ||r||                 zeta\n");
+        printf("    %5d       %20.14E%20.13f\n", *it, rnorm, *zeta);
+    }
 
     //---------------------------------------------------------------------
     // Normalize z to obtain x
     //---------------------------------------------------------------------
-    #pragma omp parallel for 
-    for (int j = 0; j < lastcol - firstcol + 1; j++)
+    if (timeron)
+        timer_start(T_IT_SCALE);
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < n; j++)
     {
         x[j] = norm_temp2 * z[j];
     }
+    if (timeron)
+        phase_end(T_IT_SCALE, 2.0 * sizeof(double) * n, 1.0 * n);
+}
+
+//---------------------------------------------------------------------
+// Vectors of blk->k interleaved systems for pb, first touched with the
+// static row schedule of conj_grad_block.
+//---------------------------------------------------------------------
+bool block_create(cg_block *blk, const cg_problem *pb, int k)
+{
+    memset(blk, 0, sizeof(*blk));
+    if (k < 1 || k > CG_MAX_RHS)
+        return false;
+
+    const size_t len = (size_t)(pb->na + 1) * k;
+    blk->k = k;
+    blk->n = pb->na;
+    blk->x = malloc(sizeof(double) * len);
+    blk->z = malloc(sizeof(double) * len);
+    blk->p = malloc(sizeof(double) * len);
+    blk->q = malloc(sizeof(double) * len);
+    blk->r = malloc(sizeof(double) * len);
+    if (blk->x == NULL || blk->z == NULL || blk->p == NULL || blk->q == NULL || blk->r == NULL)
+    {
+        block_free(blk);
+        return false;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < pb->na + 1; j++)
+    {
+        for (int s = 0; s < k; s++)
+        {
+            blk->z[j * k + s] = 0.0;
+            blk->p[j * k + s] = 0.0;
+            blk->q[j * k + s] = 0.0;
+            blk->r[j * k + s] = 0.0;
+        }
+    }
+    block_start(blk);
+    return true;
+}
+
+void block_free(cg_block *blk)
+{
+    free(blk->x);
+    free(blk->z);
+    free(blk->p);
+    free(blk->q);
+    free(blk->r);
+    memset(blk, 0, sizeof(*blk));
+}
+
+//---------------------------------------------------------------------
+// Starting vectors: system 0 is the benchmark's (1, 1, .... 1), the
+// others are fixed perturbations of it.
+//---------------------------------------------------------------------
+void block_start(cg_block *blk)
+{
+    const int k = blk->k;
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < blk->n + 1; j++)
+    {
+        for (int s = 0; s < k; s++)
+        {
+            blk->x[j * k + s] = 1.0 + 0.125 * s * (j % 7 - 3);
+        }
+    }
+}
+
+//---------------------------------------------------------------------
+// Add each thread's k partial sums, in thread order, into out[]
+//---------------------------------------------------------------------
+static void sum_partials(const double *partial, int nthreads, int stride, int k, double out[])
+{
+    for (int s = 0; s < k; s++)
+    {
+        out[s] = 0.0;
+    }
+    for (int t = 0; t < nthreads; t++)
+    {
+        for (int s = 0; s < k; s++)
+        {
+            out[s] = out[s] + partial[t * stride + s];
+        }
+    }
+}
+
+//---------------------------------------------------------------------
+// acc[s] = row j of A.v for each of the k systems interleaved in v.
+// Always inlined, so a literal k unrolls the inner loop.
+//---------------------------------------------------------------------
+static inline __attribute__((always_inline)) void spmm_row(const cg_problem *pb, int j, int k,
+                                                           const double v[], double acc[])
+{
+    for (int s = 0; s < k; s++)
+    {
+        acc[s] = 0.0;
+    }
+    for (int e = pb->rowstr[j]; e < pb->rowstr[j + 1]; e++)
+    {
+        const double aj = pb->a[e];
+        const double *vc = v + (size_t)pb->colidx[e] * k;
+        for (int s = 0; s < k; s++)
+        {
+            acc[s] = acc[s] + aj * vc[s];
+        }
+    }
+}
+
+static void spmm_row_any(const cg_problem *pb, int j, int k, const double v[], double acc[])
+{
+    switch (k)
+    {
+        case 2: spmm_row(pb, j, 2, v, acc); break;
+        case 4: spmm_row(pb, j, 4, v, acc); break;
+        case 8: spmm_row(pb, j, 8, v, acc); break;
+        case 16: spmm_row(pb, j, 16, v, acc); break;
+        default: spmm_row(pb, j, k, v, acc); break;
+    }
+}
+
+//---------------------------------------------------------------------
+// conj_grad for blk->k systems at once, each with its own alpha, beta
+// and rho, always on the double CSR matrix.  The SpMV becomes an SpMM:
+// row j loads a[k] and colidx[k] once and applies them to the k
+// adjacent values of p.
+//
+// The dot products go through per-thread partials added in a fixed
+// order.  pq and r.r alternate between two buffers, so a thread may
+// write the next one while slower threads still read the last.
+//---------------------------------------------------------------------
+void conj_grad_block(const cg_problem *pb, cg_block *blk)
+{
+    const int cgitmax = 25;
+    const int n = pb->na;
+    const int k = blk->k;
+    const double *x = blk->x;
+    double *z = blk->z;
+    double *p = blk->p;
+    double *q = blk->q;
+    double *r = blk->r;
+
+    const int stride = (k + 7) / 8 * 8;
+    const int max_threads = omp_get_max_threads();
+    double *partial[2];
+    partial[0] = malloc(sizeof(double) * stride * max_threads);
+    partial[1] = malloc(sizeof(double) * stride * max_threads);
+    if (partial[0] == NULL || partial[1] == NULL)
+    {
+        printf("Out of memory in conj_grad_block\n");
+        exit(EXIT_FAILURE);
+    }
+
+    #pragma omp parallel
+    {
+        const int me = omp_get_thread_num();
+        const int nthreads = omp_get_num_threads();
+        double *mine[2] = {partial[0] + me * stride, partial[1] + me * stride};
+        double rho[CG_MAX_RHS], alpha[CG_MAX_RHS], beta[CG_MAX_RHS], dot[CG_MAX_RHS];
+
+        //---------------------------------------------------------------------
+        // Initialize, and obtain rho = r.r in the same sweep
+        //---------------------------------------------------------------------
+        for (int s = 0; s < k; s++)
+        {
+            mine[1][s] = 0.0;
+        }
+        #pragma omp for schedule(static) nowait
+        for (int j = 0; j < n + 1; j++)
+        {
+            for (int s = 0; s < k; s++)
+            {
+                double rj = x[j * k + s];
+                q[j * k + s] = 0.0;
+                z[j * k + s] = 0.0;
+                r[j * k + s] = rj;
+                p[j * k + s] = rj;
+                if (j < n)
+                    mine[1][s] = mine[1][s] + rj * rj;
+            }
+        }
+        #pragma omp barrier
+        sum_partials(partial[1], nthreads, stride, k, rho);
+
+        for (int cgit = 1; cgit <= cgitmax; cgit++)
+        {
+            //---------------------------------------------------------------------
+            // q = A.p and p.q for all systems
+            //---------------------------------------------------------------------
+            for (int s = 0; s < k; s++)
+            {
+                mine[0][s] = 0.0;
+            }
+            #pragma omp for schedule(static) nowait
+            for (int j = 0; j < n; j++)
+            {
+                double acc[CG_MAX_RHS];
+                spmm_row_any(pb, j, k, p, acc);
+                for (int s = 0; s < k; s++)
+                {
+                    q[j * k + s] = acc[s];
+                    mine[0][s] = mine[0][s] + p[j * k + s] * acc[s];
+                }
+            }
+            #pragma omp barrier
+            sum_partials(partial[0], nthreads, stride, k, dot);
+
+            //---------------------------------------------------------------------
+            // z = z + alpha*p, r = r - alpha*q and r.r for all systems
+            //---------------------------------------------------------------------
+            for (int s = 0; s < k; s++)
+            {
+                alpha[s] = rho[s] / dot[s];
+                mine[1][s] = 0.0;
+            }
+            #pragma omp for schedule(static) nowait
+            for (int j = 0; j < n; j++)
+            {
+                for (int s = 0; s < k; s++)
+                {
+                    z[j * k + s] = z[j * k + s] + alpha[s] * p[j * k + s];
+                    r[j * k + s] = r[j * k + s] - alpha[s] * q[j * k + s];
+                    mine[1][s] = mine[1][s] + r[j * k + s] * r[j * k + s];
+                }
+            }
+            #pragma omp barrier
+            sum_partials(partial[1], nthreads, stride, k, dot);
+
+            //---------------------------------------------------------------------
+            // p = r + beta*p
+            //---------------------------------------------------------------------
+            for (int s = 0; s < k; s++)
+            {
+                beta[s] = dot[s] / rho[s];
+                rho[s] = dot[s];
+            }
+            #pragma omp for schedule(static)
+            for (int j = 0; j < n; j++)
+            {
+                for (int s = 0; s < k; s++)
+                {
+                    p[j * k + s] = r[j * k + s] + beta[s] * p[j * k + s];
+                }
+            }
+        } // end of do cgit=1,cgitmax
+
+        //---------------------------------------------------------------------
+        // ||r|| = ||x - A.z|| for each system
+        //---------------------------------------------------------------------
+        for (int s = 0; s < k; s++)
+        {
+            mine[0][s] = 0.0;
+        }
+        #pragma omp for schedule(static) nowait
+        for (int j = 0; j < n; j++)
+        {
+            double acc[CG_MAX_RHS];
+            spmm_row_any(pb, j, k, z, acc);
+            for (int s = 0; s < k; s++)
+            {
+                double d = x[j * k + s] - acc[s];
+                r[j * k + s] = acc[s];
+                mine[0][s] = mine[0][s] + d * d;
+            }
+        }
+        #pragma omp barrier
+        #pragma omp master
+        {
+            sum_partials(partial[0], nthreads, stride, k, dot);
+            for (int s = 0; s < k; s++)
+            {
+                blk->rnorm[s] = sqrt(dot[s]);
+            }
+        }
+    }
+
+    free(partial[0]);
+    free(partial[1]);
+}
+
+//---------------------------------------------------------------------
+// One inverse power step for every system; prints system 0 in the
+// format of problem_iterate.
+//---------------------------------------------------------------------
+void block_iterate(const cg_problem *pb, cg_block *blk, double zeta[], const int *it)
+{
+    const int n = pb->na;
+    const int k = blk->k;
+    const double *z = blk->z;
+    double *x = blk->x;
+    double norm_temp1[CG_MAX_RHS] = {0.0};
+    double norm_temp2[CG_MAX_RHS] = {0.0};
+
+    conj_grad_block(pb, blk);
+
+    #pragma omp parallel for schedule(static) reduction(+:norm_temp1[:k], norm_temp2[:k])
+    for (int j = 0; j < n; j++)
+    {
+        for (int s = 0; s < k; s++)
+        {
+            norm_temp1[s] = norm_temp1[s] + x[j * k + s] * z[j * k + s];
+            norm_temp2[s] = norm_temp2[s] + z[j * k + s] * z[j * k + s];
+        }
+    }
+
+    for (int s = 0; s < k; s++)
+    {
+        norm_temp2[s] = 1.0 / sqrt(norm_temp2[s]);
+        zeta[s] = pb->shift + 1.0 / norm_temp1[s];
+    }
+    if (*it == 1)
+        printf("\n   iteration           ||r||                 zeta      (system 0 of %d)\n", k);
+    printf("    %5d       %20.14E%20.13f\n", *it, blk->rnorm[0], zeta[0]);
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < n; j++)
+    {
+        for (int s = 0; s < k; s++)
+        {
+            x[j * k + s] = norm_temp2[s] * z[j * k + s];
+        }
+    }
+}
+
+void init(double *zeta){
+    problem_free(&class_problem);
+    problem_class(&class_problem);
+    problem_init(&class_problem, zeta);
+}
+
+void iterate(double *zeta, const int *it){
+    problem_iterate(&class_problem, zeta, it);
 }
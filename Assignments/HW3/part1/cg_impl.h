@@ -3,6 +3,7 @@
 #include <stdbool.h>
 
 #include "globals.h"
+#include "spmv.h"
 
 //---------------------------------------------------------------------
 /* common / main_int_mem / */
@@ -38,17 +39,111 @@ bool timeron;
 //---------------------------------------------------------------------
 
 //---------------------------------------------------------------------
-void conj_grad(const int colidx[],
-               const int rowstr[],
-               const double x[],
-               double z[],
-               const double a[],
-               double p[],
-               double q[],
-               double r[],
-               double *rnorm);
+/* sparse matrix format used by the SpMV in conj_grad */
+enum spmv_format
+{
+    SPMV_CSR = 0,
+    SPMV_SELL = 1,
+    SPMV_MIXED = 2
+};
+
+void set_spmv_format(enum spmv_format format);
+
+/* CG recurrence used by conj_grad */
+enum cg_variant
+{
+    CG_CLASSIC = 0,
+    CG_PIPELINED = 1
+};
+
+void set_cg_variant(enum cg_variant variant);
+
+/* renumber the matrix in reverse Cuthill-McKee order after makea */
+void set_matrix_reorder(bool rcm);
+
+/* stop conj_grad once ||r|| / ||r0|| < tolerance (0 = always 25 steps),
+   and precondition classic CG with the matrix diagonal */
+void set_cg_tolerance(double tolerance);
+void set_cg_jacobi(bool jacobi);
+
+/* CSR SpMV kernel by name (see csr_kernels), or "auto" to time them
+   all on the matrix at init and keep the fastest */
+bool set_csr_kernel(const char *name);
+
+/* per-phase timers of conj_grad and iterate, active when timeron is set */
+void cg_timers_clear(void);
+void cg_timers_report(void);
+//---------------------------------------------------------------------
+
+//---------------------------------------------------------------------
+/* a CG problem: its size, the matrix and the CG vectors.  init() and
+   iterate() run the compile-time class on the static arrays above;
+   problem_create() allocates a problem of any size on the heap. */
+typedef struct
+{
+    int na;
+    int nonzer;
+    double shift;
+    double rcond;
+    int nnz;
+    bool owned;
+    int *rowstr;
+    int *colidx;
+    double *a;
+    double *x;
+    double *z;
+    double *p;
+    double *q;
+    double *r;
+    double *w; // A.r, A.p and A.s, pipelined CG only
+    double *s;
+    double *u;
+    double *dinv; // 1 / diagonal, Jacobi preconditioning only
+    double tolerance;
+    enum spmv_format format;
+    enum cg_variant variant;
+    csr_kernel csr;
+    sell_matrix sell;
+    mixed_matrix mixed;
+} cg_problem;
+
+void problem_class(cg_problem *pb);
+bool problem_create(cg_problem *pb, int na, int nonzer, double shift);
+void problem_free(cg_problem *pb);
+void problem_init(cg_problem *pb, double *zeta);
+void problem_iterate(cg_problem *pb, double *zeta, const int *it);
+//---------------------------------------------------------------------
+
+//---------------------------------------------------------------------
+/* K independent right-hand sides solved together with one problem's
+   matrix, so every a/colidx load of the SpMV serves all K systems.
+   Vectors are interleaved: element j of system s is at [j * k + s]. */
+#define CG_MAX_RHS 16
+
+typedef struct
+{
+    int k;
+    int n;
+    double *x;
+    double *z;
+    double *p;
+    double *q;
+    double *r;
+    double rnorm[CG_MAX_RHS];
+} cg_block;
+
+bool block_create(cg_block *blk, const cg_problem *pb, int k);
+void block_free(cg_block *blk);
+void block_start(cg_block *blk);
+void conj_grad_block(const cg_problem *pb, cg_block *blk);
+void block_iterate(const cg_problem *pb, cg_block *blk, double zeta[], const int *it);
+//---------------------------------------------------------------------
+
+//---------------------------------------------------------------------
+int conj_grad(const cg_problem *pb, double *rnorm);
 void makea(int n,
            int nz,
+           int nonzer,
            double a[],
            int colidx[],
            int rowstr[],
@@ -57,9 +152,11 @@ void makea(int n,
            int firstcol,
            int lastcol,
            int arow[],
-           int acol[][NONZER + 1],
-           double aelt[][NONZER + 1],
-           int iv[]);
+           int acol[][nonzer + 1],
+           double aelt[][nonzer + 1],
+           int iv[],
+           double rcond,
+           double shift);
 void sparse(double a[],
             int colidx[],
             int rowstr[],
@@ -67,8 +164,8 @@ void sparse(double a[],
             int nz,
             int nozer,
             const int arow[],
-            int acol[][NONZER + 1],
-            double aelt[][NONZER + 1],
+            int acol[][nozer + 1],
+            double aelt[][nozer + 1],
             int firstrow,
             int lastrow,
             int nzloc[],
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+#include <numa.h>
+#include <numaif.h>
+#include <omp.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cg_numa.h"
+
+static bool interleaved = false;
+
+bool cg_numa_interleave(void)
+{
+    if (numa_available() < 0)
+        return false;
+    numa_set_interleave_mask(numa_all_nodes_ptr);
+    interleaved = true;
+    return true;
+}
+
+//---------------------------------------------------------------------
+// add the bytes of [base, base + bytes) resident on each node to
+// node_bytes; pages not yet touched are not counted
+//---------------------------------------------------------------------
+static void count_pages(const void *base, size_t bytes, int nodes, double node_bytes[])
+{
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)base & ~(page - 1);
+    uintptr_t last = ((uintptr_t)base + bytes + page - 1) & ~(page - 1);
+    unsigned long count = (last - first) / page;
+    void **pages = malloc(sizeof(void *) * count);
+    int *status = malloc(sizeof(int) * count);
+    if (pages == NULL || status == NULL)
+    {
+        free(pages);
+        free(status);
+        return;
+    }
+
+    for (unsigned long i = 0; i < count; i++)
+    {
+        pages[i] = (void *)(first + i * page);
+    }
+    if (numa_move_pages(0, count, pages, NULL, status, 0) == 0)
+    {
+        for (unsigned long i = 0; i < count; i++)
+        {
+            if (status[i] >= 0 && status[i] < nodes)
+                node_bytes[status[i]] += page;
+        }
+    }
+    free(pages);
+    free(status);
+}
+
+void cg_numa_report(const cg_problem *pb)
+{
+    if (numa_available() < 0)
+    {
+        printf(" NUMA: not available\n");
+        return;
+    }
+
+    const int nodes = numa_max_node() + 1;
+    const int n = pb->na;
+    const int reps = 5;
+    double *matrix_bytes = calloc(nodes, sizeof(double));
+    double *vector_bytes = calloc(nodes, sizeof(double));
+    double *spmv_bytes = calloc(nodes, sizeof(double));
+    double *spmv_time = calloc(nodes, sizeof(double));
+    int *threads = calloc(nodes, sizeof(int));
+    if (matrix_bytes == NULL || vector_bytes == NULL || spmv_bytes == NULL || spmv_time == NULL
+        || threads == NULL)
+    {
+        printf(" NUMA: out of memory for the placement report\n");
+        free(matrix_bytes);
+        free(vector_bytes);
+        free(spmv_bytes);
+        free(spmv_time);
+        free(threads);
+        return;
+    }
+
+    count_pages(pb->a, sizeof(double) * pb->nnz, nodes, matrix_bytes);
+    count_pages(pb->colidx, sizeof(int) * pb->nnz, nodes, matrix_bytes);
+    count_pages(pb->rowstr, sizeof(int) * (n + 1), nodes, matrix_bytes);
+    count_pages(pb->x, sizeof(double) * (n + 2), nodes, vector_bytes);
+    count_pages(pb->z, sizeof(double) * (n + 2), nodes, vector_bytes);
+    count_pages(pb->p, sizeof(double) * (n + 2), nodes, vector_bytes);
+    count_pages(pb->q, sizeof(double) * (n + 2), nodes, vector_bytes);
+    count_pages(pb->r, sizeof(double) * (n + 2), nodes, vector_bytes);
+
+    //---------------------------------------------------------------------
+    // Each thread times its static share of q = A.p, as conj_grad would
+    // run it, and charges the bytes it streams to the node it runs on.
+    // Run with OMP_PROC_BIND=true so threads stay on their node.
+    //---------------------------------------------------------------------
+    #pragma omp parallel
+    {
+        int node = numa_node_of_cpu(sched_getcpu());
+        double bytes = 0.0;
+        double start;
+
+        #pragma omp barrier
+        start = omp_get_wtime();
+        for (int rep = 0; rep < reps; rep++)
+        {
+            #pragma omp for schedule(static) nowait
+            for (int j = 0; j < n; j++)
+            {
+                double sum = 0.0;
+                for (int k = pb->rowstr[j]; k < pb->rowstr[j + 1]; k++)
+                {
+                    sum = sum + pb->a[k] * pb->p[pb->colidx[k]];
+                }
+                pb->q[j] = sum;
+                bytes += (pb->rowstr[j + 1] - pb->rowstr[j]) * (sizeof(double) + sizeof(int))
+                         + sizeof(int) + 2 * sizeof(double);
+            }
+        }
+        double elapsed = omp_get_wtime() - start;
+
+        if (node >= 0 && node < nodes)
+        {
+            #pragma omp critical(numa_report)
+            {
+                threads[node]++;
+                spmv_bytes[node] += bytes;
+                if (elapsed > spmv_time[node])
+                    spmv_time[node] = elapsed;
+            }
+        }
+    }
+
+    printf(" NUMA placement: %s, %d node%s\n", interleaved ? "interleaved" : "first touch", nodes,
+           nodes == 1 ? "" : "s");
+    printf("   node threads   matrix MB   vector MB   SpMV GB/s\n");
+    for (int node = 0; node < nodes; node++)
+    {
+        if (numa_bitmask_isbitset(numa_all_nodes_ptr, node) == 0)
+            continue;
+        printf("   %4d %7d %11.2f %11.2f %11.2f\n", node, threads[node], matrix_bytes[node] / 1e6,
+               vector_bytes[node] / 1e6,
+               spmv_time[node] > 0 ? spmv_bytes[node] / spmv_time[node] / 1e9 : 0.0);
+    }
+
+    free(matrix_bytes);
+    free(vector_bytes);
+    free(spmv_bytes);
+    free(spmv_time);
+    free(threads);
+}
@@ -0,0 +1,17 @@
+#ifndef CG_NUMA_H
+#define CG_NUMA_H
+
+#include <stdbool.h>
+
+#include "cg_impl.h"
+
+// Interleave every page faulted in from now on across all NUMA nodes,
+// instead of placing it on the node of the thread that touches it
+// first.  Returns false if the machine or kernel has no NUMA support.
+bool cg_numa_interleave(void);
+
+// Print, for each NUMA node, how much of the matrix and the CG vectors
+// lives there and the SpMV bandwidth its threads achieve.
+void cg_numa_report(const cg_problem *pb);
+
+#endif // CG_NUMA_H
@@ -39,7 +39,14 @@ enum
     T_INIT = 0,
     T_BENCH = 1,
     T_CONJ_GRAD = 2,
-    T_LAST = 3
+    T_CG_INIT = 3,    // z = 0, r = p = x, rho = r.r
+    T_CG_SPMV = 4,    // q = A.p and p.q
+    T_CG_AXPY = 5,    // z += alpha*p, r -= alpha*q, r.r
+    T_CG_PUPDATE = 6, // p = r + beta*p
+    T_CG_RESID = 7,   // ||x - A.z||
+    T_IT_NORM = 8,    // x.z and z.z
+    T_IT_SCALE = 9,   // x = z / ||z||
+    T_LAST = 10
 };
 
 #endif // GLOBALS_H
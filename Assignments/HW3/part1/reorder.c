@@ -0,0 +1,226 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reorder.h"
+
+static void *alloc_or_die(size_t bytes)
+{
+    void *ptr = malloc(bytes);
+    if (ptr == NULL)
+    {
+        printf("Out of memory allocating %zu bytes for reordering\n", bytes);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+int matrix_bandwidth(int n, const int rowstr[], const int colidx[])
+{
+    int bandwidth = 0;
+
+    #pragma omp parallel for schedule(static) reduction(max:bandwidth)
+    for (int j = 0; j < n; j++)
+    {
+        for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
+        {
+            int d = colidx[k] > j ? colidx[k] - j : j - colidx[k];
+            if (d > bandwidth)
+                bandwidth = d;
+        }
+    }
+    return bandwidth;
+}
+
+//---------------------------------------------------------------------
+// Breadth-first search from start over the rows not yet placed.
+// queue receives the rows in visiting order and level[] their depth
+// (level[] must be -1 for every row still unvisited).  Returns the
+// number of rows reached; *depth is the deepest level.
+//---------------------------------------------------------------------
+static int bfs_levels(const int rowstr[], const int colidx[], int start, int level[], int queue[],
+                      int *depth)
+{
+    int head = 0;
+    int tail = 0;
+
+    queue[tail++] = start;
+    level[start] = 0;
+    while (head < tail)
+    {
+        int row = queue[head++];
+        for (int k = rowstr[row]; k < rowstr[row + 1]; k++)
+        {
+            int col = colidx[k];
+            if (level[col] < 0)
+            {
+                level[col] = level[row] + 1;
+                queue[tail++] = col;
+            }
+        }
+    }
+    *depth = level[queue[tail - 1]];
+    return tail;
+}
+
+//---------------------------------------------------------------------
+// George-Liu heuristic: restart the search from the lowest-degree row
+// of the deepest level until the depth stops growing.
+//---------------------------------------------------------------------
+static int pseudo_peripheral(const int rowstr[], const int colidx[], int start, int level[],
+                             int queue[])
+{
+    int depth, best_depth = -1;
+
+    for (;;)
+    {
+        int count = bfs_levels(rowstr, colidx, start, level, queue, &depth);
+
+        int next = queue[count - 1];
+        for (int i = count - 1; i >= 0 && level[queue[i]] == depth; i--)
+        {
+            int row = queue[i];
+            if (rowstr[row + 1] - rowstr[row] < rowstr[next + 1] - rowstr[next])
+                next = row;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            level[queue[i]] = -1;
+        }
+
+        if (depth <= best_depth)
+            return start;
+        best_depth = depth;
+        start = next;
+    }
+}
+
+void rcm_order(int n, const int rowstr[], const int colidx[], int perm[])
+{
+    int *level = alloc_or_die(sizeof(int) * n);
+    int *queue = alloc_or_die(sizeof(int) * n);
+    bool *placed = alloc_or_die(sizeof(bool) * n);
+    int count = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        level[i] = -1;
+        placed[i] = false;
+    }
+
+    for (int seed = 0; seed < n; seed++)
+    {
+        if (placed[seed])
+            continue;
+
+        //---------------------------------------------------------------------
+        // Cuthill-McKee over this component: visit each row's unplaced
+        // neighbours by increasing degree (row number breaks ties)
+        //---------------------------------------------------------------------
+        int head = count;
+        int start = pseudo_peripheral(rowstr, colidx, seed, level, queue);
+        perm[count++] = start;
+        placed[start] = true;
+        while (head < count)
+        {
+            int row = perm[head++];
+            int first = count;
+            for (int k = rowstr[row]; k < rowstr[row + 1]; k++)
+            {
+                int col = colidx[k];
+                if (placed[col])
+                    continue;
+                placed[col] = true;
+
+                int deg = rowstr[col + 1] - rowstr[col];
+                int i = count++;
+                while (i > first && rowstr[perm[i - 1] + 1] - rowstr[perm[i - 1]] > deg)
+                {
+                    perm[i] = perm[i - 1];
+                    i--;
+                }
+                perm[i] = col;
+            }
+        }
+    }
+
+    //---------------------------------------------------------------------
+    // reverse
+    //---------------------------------------------------------------------
+    for (int i = 0; i < n / 2; i++)
+    {
+        int t = perm[i];
+        perm[i] = perm[n - 1 - i];
+        perm[n - 1 - i] = t;
+    }
+
+    free(level);
+    free(queue);
+    free(placed);
+}
+
+void permute_matrix(int n, int rowstr[], int colidx[], double a[], const int perm[])
+{
+    const int nnz = rowstr[n];
+    int *inv = alloc_or_die(sizeof(int) * n);
+    int *new_rowstr = alloc_or_die(sizeof(int) * (n + 1));
+    int *pos = alloc_or_die(sizeof(int) * n);
+    int *new_colidx = alloc_or_die(sizeof(int) * nnz);
+    double *new_a = alloc_or_die(sizeof(double) * nnz);
+
+    for (int i = 0; i < n; i++)
+    {
+        inv[perm[i]] = i;
+    }
+    new_rowstr[0] = 0;
+    for (int i = 0; i < n; i++)
+    {
+        new_rowstr[i + 1] = new_rowstr[i] + rowstr[perm[i] + 1] - rowstr[perm[i]];
+        pos[i] = new_rowstr[i];
+    }
+
+    //---------------------------------------------------------------------
+    // Walk the new rows in order and scatter each entry into the row of
+    // its new column: that builds (P A P^T)^T, which is P A P^T since A
+    // is symmetric, with every row's columns already sorted.
+    //---------------------------------------------------------------------
+    for (int i = 0; i < n; i++)
+    {
+        int old = perm[i];
+        for (int k = rowstr[old]; k < rowstr[old + 1]; k++)
+        {
+            int col = inv[colidx[k]];
+            new_colidx[pos[col]] = i;
+            new_a[pos[col]] = a[k];
+            pos[col]++;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (pos[i] != new_rowstr[i + 1])
+        {
+            printf("Matrix is not structurally symmetric, cannot reorder\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //---------------------------------------------------------------------
+    // copy back with the static row schedule of the SpMV
+    //---------------------------------------------------------------------
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        int begin = new_rowstr[i];
+        int end = new_rowstr[i + 1];
+        memcpy(colidx + begin, new_colidx + begin, sizeof(int) * (end - begin));
+        memcpy(a + begin, new_a + begin, sizeof(double) * (end - begin));
+        rowstr[i + 1] = end;
+    }
+
+    free(inv);
+    free(new_rowstr);
+    free(pos);
+    free(new_colidx);
+    free(new_a);
+}
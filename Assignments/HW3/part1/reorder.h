@@ -0,0 +1,22 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+//---------------------------------------------------------------------
+// Bandwidth-reducing symmetric reordering of the CG matrix.
+//
+// The matrix is structurally symmetric, so renumbering rows and columns
+// with the same permutation keeps it symmetric positive definite and CG
+// converges to the same zeta; only the order of the sums changes.
+//---------------------------------------------------------------------
+
+// largest |row - column| over the stored entries
+int matrix_bandwidth(int n, const int rowstr[], const int colidx[]);
+
+// Reverse Cuthill-McKee order: perm[new] = old.  Each connected
+// component starts from a pseudo-peripheral row.
+void rcm_order(int n, const int rowstr[], const int colidx[], int perm[]);
+
+// Replace A by P A P^T in place.  Columns stay increasing in each row.
+void permute_matrix(int n, int rowstr[], int colidx[], double a[], const int perm[]);
+
+#endif // REORDER_H
@@ -0,0 +1,431 @@
+#include <immintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spmv.h"
+
+typedef struct
+{
+    int len;
+    int row;
+} row_key;
+
+//---------------------------------------------------------------------
+// longer rows first; equal lengths keep their original order
+//---------------------------------------------------------------------
+static int by_length(const void *lhs, const void *rhs)
+{
+    const row_key *l = lhs;
+    const row_key *r = rhs;
+    if (l->len != r->len)
+        return r->len - l->len;
+    return l->row - r->row;
+}
+
+static void *alloc_aligned(size_t bytes)
+{
+    // aligned_alloc wants a multiple of the alignment
+    void *ptr = aligned_alloc(64, (bytes + 63) / 64 * 64);
+    if (ptr == NULL)
+    {
+        printf("Out of memory allocating %zu bytes for sparse matrix\n", bytes);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+//---------------------------------------------------------------------
+// Scatter a slice's accumulators back to the original rows and return
+// their dot product with v.
+//---------------------------------------------------------------------
+static inline double sell_store(const sell_matrix *m, int s, const double acc[], const double v[], double q[])
+{
+    const int *perm = m->perm + s * SELL_C;
+    double dot = 0.0;
+    for (int l = 0; l < SELL_C; l++)
+    {
+        int row = perm[l];
+        if (row < 0)
+            break;
+        q[row] = acc[l];
+        dot = dot + v[row] * acc[l];
+    }
+    return dot;
+}
+
+//---------------------------------------------------------------------
+// The kernels add a[k] * v[col[k]] to each row in the same order as the
+// CSR loop in conj_grad, and padding adds an exact 0.0, so every kernel
+// produces bit-identical q.  Multiply and add are kept separate (this
+// file is built with -ffp-contract=off) for the same reason.
+//---------------------------------------------------------------------
+static double sell_slice_scalar(const sell_matrix *m, int s, const double v[], double q[])
+{
+    const int begin = m->slice_ptr[s];
+    const int end = m->slice_ptr[s + 1];
+    double acc[SELL_C] = {0.0};
+
+    for (int k = begin; k < end; k += SELL_C)
+    {
+        for (int l = 0; l < SELL_C; l++)
+        {
+            acc[l] = acc[l] + m->val[k + l] * v[m->col[k + l]];
+        }
+    }
+    return sell_store(m, s, acc, v, q);
+}
+
+__attribute__((target("avx2")))
+static double sell_slice_avx2(const sell_matrix *m, int s, const double v[], double q[])
+{
+    const int begin = m->slice_ptr[s];
+    const int end = m->slice_ptr[s + 1];
+    __m256d lo = _mm256_setzero_pd();
+    __m256d hi = _mm256_setzero_pd();
+
+    for (int k = begin; k < end; k += SELL_C)
+    {
+        __m128i idx_lo = _mm_load_si128((const __m128i *)(m->col + k));
+        __m128i idx_hi = _mm_load_si128((const __m128i *)(m->col + k + 4));
+        __m256d v_lo = _mm256_i32gather_pd(v, idx_lo, 8);
+        __m256d v_hi = _mm256_i32gather_pd(v, idx_hi, 8);
+        lo = _mm256_add_pd(lo, _mm256_mul_pd(_mm256_load_pd(m->val + k), v_lo));
+        hi = _mm256_add_pd(hi, _mm256_mul_pd(_mm256_load_pd(m->val + k + 4), v_hi));
+    }
+
+    double acc[SELL_C];
+    _mm256_storeu_pd(acc, lo);
+    _mm256_storeu_pd(acc + 4, hi);
+    return sell_store(m, s, acc, v, q);
+}
+
+__attribute__((target("avx512f")))
+static double sell_slice_avx512(const sell_matrix *m, int s, const double v[], double q[])
+{
+    const int begin = m->slice_ptr[s];
+    const int end = m->slice_ptr[s + 1];
+    __m512d sum = _mm512_setzero_pd();
+
+    for (int k = begin; k < end; k += SELL_C)
+    {
+        __m256i idx = _mm256_load_si256((const __m256i *)(m->col + k));
+        __m512d vk = _mm512_i32gather_pd(idx, v, 8);
+        sum = _mm512_add_pd(sum, _mm512_mul_pd(_mm512_load_pd(m->val + k), vk));
+    }
+
+    double acc[SELL_C];
+    _mm512_storeu_pd(acc, sum);
+    return sell_store(m, s, acc, v, q);
+}
+
+const char *sell_isa(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return "avx512";
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+    return "scalar";
+}
+
+//---------------------------------------------------------------------
+// Convert the CSR matrix (rowstr, colidx, a) to SELL-C-sigma.
+//---------------------------------------------------------------------
+void sell_build(sell_matrix *m, int nrows, const int rowstr[], const int colidx[], const double a[])
+{
+    m->nrows = nrows;
+    m->nslices = (nrows + SELL_C - 1) / SELL_C;
+    m->nnz = rowstr[nrows] - rowstr[0];
+
+    //---------------------------------------------------------------------
+    // sort rows by length inside each sigma window
+    //---------------------------------------------------------------------
+    row_key *keys = alloc_aligned(sizeof(row_key) * nrows);
+    for (int j = 0; j < nrows; j++)
+    {
+        keys[j].len = rowstr[j + 1] - rowstr[j];
+        keys[j].row = j;
+    }
+    for (int w = 0; w < nrows; w += SELL_SIGMA)
+    {
+        int n = nrows - w < SELL_SIGMA ? nrows - w : SELL_SIGMA;
+        qsort(keys + w, n, sizeof(row_key), by_length);
+    }
+
+    //---------------------------------------------------------------------
+    // slice widths are the first (longest) row of each slice
+    //---------------------------------------------------------------------
+    m->perm = alloc_aligned(sizeof(int) * m->nslices * SELL_C);
+    m->slice_ptr = alloc_aligned(sizeof(int) * (m->nslices + 1));
+    m->slice_ptr[0] = 0;
+    for (int s = 0; s < m->nslices; s++)
+    {
+        int width = 0;
+        for (int l = 0; l < SELL_C; l++)
+        {
+            int j = s * SELL_C + l;
+            m->perm[j] = j < nrows ? keys[j].row : -1;
+            if (j < nrows && keys[j].len > width)
+                width = keys[j].len;
+        }
+        m->slice_ptr[s + 1] = m->slice_ptr[s] + width * SELL_C;
+    }
+    free(keys);
+
+    //---------------------------------------------------------------------
+    // fill column-major slices; padding multiplies 0.0 by v[0]
+    //---------------------------------------------------------------------
+    m->val = alloc_aligned(sizeof(double) * m->slice_ptr[m->nslices]);
+    m->col = alloc_aligned(sizeof(int) * m->slice_ptr[m->nslices]);
+
+    #pragma omp parallel for schedule(static)
+    for (int s = 0; s < m->nslices; s++)
+    {
+        const int base = m->slice_ptr[s];
+        const int width = (m->slice_ptr[s + 1] - base) / SELL_C;
+        for (int l = 0; l < SELL_C; l++)
+        {
+            int row = m->perm[s * SELL_C + l];
+            int len = row < 0 ? 0 : rowstr[row + 1] - rowstr[row];
+            for (int k = 0; k < width; k++)
+            {
+                int dst = base + k * SELL_C + l;
+                if (k < len)
+                {
+                    m->val[dst] = a[rowstr[row] + k];
+                    m->col[dst] = colidx[rowstr[row] + k];
+                }
+                else
+                {
+                    m->val[dst] = 0.0;
+                    m->col[dst] = 0;
+                }
+            }
+        }
+    }
+
+    const char *isa = sell_isa();
+    if (strcmp(isa, "avx512") == 0)
+        m->kernel = sell_slice_avx512;
+    else if (strcmp(isa, "avx2") == 0)
+        m->kernel = sell_slice_avx2;
+    else
+        m->kernel = sell_slice_scalar;
+}
+
+void sell_free(sell_matrix *m)
+{
+    free(m->slice_ptr);
+    free(m->perm);
+    free(m->val);
+    free(m->col);
+    memset(m, 0, sizeof(*m));
+}
+
+//---------------------------------------------------------------------
+// Convert the CSR matrix (rowstr, colidx, a) to mixed precision.
+// colidx must be increasing within each row, as sparse() leaves it.
+//---------------------------------------------------------------------
+void mixed_build(mixed_matrix *m, int nrows, const int rowstr[], const int colidx[], const double a[])
+{
+    m->nrows = nrows;
+    m->rowptr = alloc_aligned(sizeof(int) * (nrows + 1));
+    m->rowbase = alloc_aligned(sizeof(int) * nrows);
+
+    //---------------------------------------------------------------------
+    // count entries per row, fillers included
+    //---------------------------------------------------------------------
+    m->rowptr[0] = 0;
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < nrows; j++)
+    {
+        int count = 0;
+        for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
+        {
+            if (k > rowstr[j])
+                count += (colidx[k] - colidx[k - 1] - 1) / 65535;
+            count++;
+        }
+        m->rowptr[j + 1] = count;
+    }
+    for (int j = 0; j < nrows; j++)
+    {
+        m->rowptr[j + 1] += m->rowptr[j];
+    }
+    m->nnz = m->rowptr[nrows];
+    m->nfill = m->nnz - (rowstr[nrows] - rowstr[0]);
+
+    m->delta = alloc_aligned(sizeof(unsigned short) * m->nnz);
+    m->val = alloc_aligned(sizeof(float) * m->nnz);
+
+    #pragma omp parallel for schedule(static)
+    for (int j = 0; j < nrows; j++)
+    {
+        int dst = m->rowptr[j];
+        int col = rowstr[j] < rowstr[j + 1] ? colidx[rowstr[j]] : 0;
+        m->rowbase[j] = col;
+        for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
+        {
+            while (colidx[k] - col > 65535)
+            {
+                m->delta[dst] = 65535;
+                m->val[dst] = 0.0f;
+                col += 65535;
+                dst++;
+            }
+            m->delta[dst] = (unsigned short)(colidx[k] - col);
+            m->val[dst] = (float)a[k];
+            col = colidx[k];
+            dst++;
+        }
+    }
+}
+
+void mixed_free(mixed_matrix *m)
+{
+    free(m->rowptr);
+    free(m->rowbase);
+    free(m->delta);
+    free(m->val);
+    memset(m, 0, sizeof(*m));
+}
+
+//---------------------------------------------------------------------
+// CSR kernel library
+//---------------------------------------------------------------------
+static double csr_plain(int begin, int end, const int rowstr[], const int colidx[],
+                        const double a[], const double v[], double q[], double dot)
+{
+    for (int j = begin; j < end; j++)
+    {
+        double sum = 0.0;
+        for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
+        {
+            sum = sum + a[k] * v[colidx[k]];
+        }
+        q[j] = sum;
+        dot = dot + v[j] * sum;
+    }
+    return dot;
+}
+
+static double csr_unroll2(int begin, int end, const int rowstr[], const int colidx[],
+                          const double a[], const double v[], double q[], double dot)
+{
+    for (int j = begin; j < end; j++)
+    {
+        const int last = rowstr[j + 1];
+        double sum0 = 0.0, sum1 = 0.0;
+        int k = rowstr[j];
+        for (; k + 1 < last; k += 2)
+        {
+            sum0 = sum0 + a[k] * v[colidx[k]];
+            sum1 = sum1 + a[k + 1] * v[colidx[k + 1]];
+        }
+        if (k < last)
+            sum0 = sum0 + a[k] * v[colidx[k]];
+        q[j] = sum0 + sum1;
+        dot = dot + v[j] * q[j];
+    }
+    return dot;
+}
+
+static double csr_unroll8(int begin, int end, const int rowstr[], const int colidx[],
+                          const double a[], const double v[], double q[], double dot)
+{
+    for (int j = begin; j < end; j++)
+    {
+        const int last = rowstr[j + 1];
+        double s[8] = {0.0};
+        int k = rowstr[j];
+        for (; k + 7 < last; k += 8)
+        {
+            for (int l = 0; l < 8; l++)
+            {
+                s[l] = s[l] + a[k + l] * v[colidx[k + l]];
+            }
+        }
+        double sum = ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+        for (; k < last; k++)
+        {
+            sum = sum + a[k] * v[colidx[k]];
+        }
+        q[j] = sum;
+        dot = dot + v[j] * sum;
+    }
+    return dot;
+}
+
+//---------------------------------------------------------------------
+// two rows at a time: independent chains for the common length, then
+// the longer row's tail
+//---------------------------------------------------------------------
+static double csr_rows2(int begin, int end, const int rowstr[], const int colidx[],
+                        const double a[], const double v[], double q[], double dot)
+{
+    int j = begin;
+    for (; j + 1 < end; j += 2)
+    {
+        const int k0 = rowstr[j];
+        const int k1 = rowstr[j + 1];
+        const int len0 = k1 - k0;
+        const int len1 = rowstr[j + 2] - k1;
+        const int common = len0 < len1 ? len0 : len1;
+        double sum0 = 0.0, sum1 = 0.0;
+        for (int l = 0; l < common; l++)
+        {
+            sum0 = sum0 + a[k0 + l] * v[colidx[k0 + l]];
+            sum1 = sum1 + a[k1 + l] * v[colidx[k1 + l]];
+        }
+        for (int l = common; l < len0; l++)
+        {
+            sum0 = sum0 + a[k0 + l] * v[colidx[k0 + l]];
+        }
+        for (int l = common; l < len1; l++)
+        {
+            sum1 = sum1 + a[k1 + l] * v[colidx[k1 + l]];
+        }
+        q[j] = sum0;
+        q[j + 1] = sum1;
+        dot = dot + v[j] * sum0;
+        dot = dot + v[j + 1] * sum1;
+    }
+    if (j < end)
+        dot = csr_plain(j, end, rowstr, colidx, a, v, q, dot);
+    return dot;
+}
+
+//---------------------------------------------------------------------
+// plain loop with the v gather CSR_PREFETCH nonzeros ahead prefetched;
+// indices past the block prefetch v[0] instead of reading colidx beyond
+// the rows handed in
+//---------------------------------------------------------------------
+static double csr_prefetch(int begin, int end, const int rowstr[], const int colidx[],
+                           const double a[], const double v[], double q[], double dot)
+{
+    const int stop = rowstr[end];
+    for (int j = begin; j < end; j++)
+    {
+        double sum = 0.0;
+        for (int k = rowstr[j]; k < rowstr[j + 1]; k++)
+        {
+            int ahead = k + CSR_PREFETCH < stop ? colidx[k + CSR_PREFETCH] : 0;
+            __builtin_prefetch(v + ahead, 0, 1);
+            sum = sum + a[k] * v[colidx[k]];
+        }
+        q[j] = sum;
+        dot = dot + v[j] * sum;
+    }
+    return dot;
+}
+
+const csr_kernel_info csr_kernels[] = {
+    {"csr", csr_plain},
+    {"unroll2", csr_unroll2},
+    {"unroll8", csr_unroll8},
+    {"rows2", csr_rows2},
+    {"prefetch", csr_prefetch},
+};
+
+const int csr_kernel_count = sizeof(csr_kernels) / sizeof(csr_kernels[0]);
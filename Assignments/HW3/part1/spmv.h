@@ -0,0 +1,93 @@
+#ifndef SPMV_H
+#define SPMV_H
+
+//---------------------------------------------------------------------
+// SELL-C-sigma (sliced ELLPACK) storage for the CG matrix.
+//
+// Rows are sorted by decreasing length inside windows of sigma rows,
+// then cut into slices of SELL_C rows.  Each slice is padded to its
+// longest row and stored column-major, so one SIMD register holds the
+// k-th nonzero of SELL_C consecutive (sorted) rows.
+//---------------------------------------------------------------------
+#define SELL_C     8
+#define SELL_SIGMA 256
+
+typedef struct sell_matrix sell_matrix;
+
+// q = A.v over the rows of slice s; returns the sum of v[row] * q[row]
+// over those rows.
+typedef double (*sell_kernel)(const sell_matrix *m, int s, const double v[], double q[]);
+
+struct sell_matrix
+{
+    int nrows;
+    int nslices;
+    int *slice_ptr; // nslices + 1 offsets into val / col
+    int *perm;      // nslices * SELL_C original row numbers, -1 for padding
+    double *val;
+    int *col;
+    long nnz;
+    sell_kernel kernel;
+};
+
+void sell_build(sell_matrix *m, int nrows, const int rowstr[], const int colidx[], const double a[]);
+void sell_free(sell_matrix *m);
+const char *sell_isa(void);
+
+//---------------------------------------------------------------------
+// Mixed-precision CSR: float values and 16-bit column deltas.
+//
+// Column k of row j is rowbase[j] plus the sum of delta[rowptr[j]..k].
+// A gap wider than 65535 is bridged with explicit zeros, which add an
+// exact 0.0 to the row sum.  6 bytes per nonzero instead of 12.
+//---------------------------------------------------------------------
+typedef struct
+{
+    int nrows;
+    int *rowptr;
+    int *rowbase;
+    unsigned short *delta;
+    float *val;
+    long nnz;   // entries stored, including fillers
+    long nfill; // zero entries bridging wide gaps
+} mixed_matrix;
+
+void mixed_build(mixed_matrix *m, int nrows, const int rowstr[], const int colidx[], const double a[]);
+void mixed_free(mixed_matrix *m);
+
+// row j of A.v, accumulated in double
+static inline double mixed_row(const mixed_matrix *m, int j, const double v[])
+{
+    double sum = 0.0;
+    int col = m->rowbase[j];
+    for (int k = m->rowptr[j]; k < m->rowptr[j + 1]; k++)
+    {
+        col += m->delta[k];
+        sum = sum + (double)m->val[k] * v[col];
+    }
+    return sum;
+}
+
+//---------------------------------------------------------------------
+// CSR kernels.  Each computes q = A.v over rows [begin, end) and
+// returns dot plus v[row] * q[row] added row by row, so a thread can
+// carry its p.q partial from one block of rows to the next.
+//---------------------------------------------------------------------
+#define CSR_BLOCK    256 // rows per kernel call
+#define CSR_PREFETCH 32  // nonzeros ahead for the prefetching kernel
+
+typedef double (*csr_kernel)(int begin, int end, const int rowstr[], const int colidx[],
+                             const double a[], const double v[], double q[], double dot);
+
+typedef struct
+{
+    const char *name;
+    csr_kernel kernel;
+} csr_kernel_info;
+
+// plain first; "rows2" and "prefetch" keep its summation order, the
+// unrolled ones split each row over several accumulators
+extern const csr_kernel_info csr_kernels[];
+extern const int csr_kernel_count;
+
+#endif // SPMV_H
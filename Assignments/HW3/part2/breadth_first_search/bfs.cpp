@@ -41,17 +41,18 @@ void vertex_set_destroy(VertexSet *list)
 // Take one step of "top-down" BFS.  For each vertex on the frontier,
 // follow all outgoing edges, and add all neighboring vertices to the
 // new_frontier.
-void top_down_step(Graph g, VertexSet *frontier, VertexSet *new_frontier, int *distances)
+template <typename G>
+void top_down_step(G g, VertexSet *frontier, VertexSet *new_frontier, int *distances)
 {
     #pragma omp parallel for schedule(dynamic, Cpy)
     for (int i = 0; i < frontier->count; i++)
     {
         int node = frontier->vertices[i];
-        int start_edge = g->outgoing_starts[node];
-        int end_edge = (node == g->num_nodes - 1) ? g->num_edges : g->outgoing_starts[node + 1];
+        auto start_edge = g->outgoing_starts[node];
+        auto end_edge = (node == g->num_nodes - 1) ? g->num_edges : g->outgoing_starts[node + 1];
 
         // attempt to add all neighbors to the new frontier
-        for (int neighbor = start_edge; neighbor < end_edge; neighbor++)
+        for (auto neighbor = start_edge; neighbor < end_edge; neighbor++)
         {
             int outgoing = g->outgoing_edges[neighbor];
 
@@ -118,7 +119,7 @@ void top_down_step(Graph g, VertexSet *frontier, VertexSet *new_frontier, int *d
 //
 // Result of execution is that, for each node in the graph, the
 // distance to the root is stored in sol.distances.
-void bfs_top_down(Graph graph, solution *sol)
+template <typename G> void bfs_top_down_impl(G graph, solution *sol)
 {
 
     VertexSet list1;
@@ -165,7 +166,8 @@ void bfs_top_down(Graph graph, solution *sol)
     vertex_set_destroy(&list2);
 }
 
-void bottom_up_step(Graph g, VertexSet *frontier, VertexSet *new_frontier, int *distances){
+template <typename G>
+void bottom_up_step(G g, VertexSet *frontier, VertexSet *new_frontier, int *distances){
     VertexSet threadtemp[omp_get_max_threads()];
 
     for (int i = 0; i < omp_get_max_threads(); i++)
@@ -177,10 +179,10 @@ void bottom_up_step(Graph g, VertexSet *frontier, VertexSet *new_frontier, int *
         if (distances[u] != NOT_VISITED_MARKER)
             continue;  // 已經訪問過
 
-        int start = g->incoming_starts[u];
-        int end = (u == g->num_nodes - 1) ? g->num_edges : g->incoming_starts[u + 1];
+        auto start = g->incoming_starts[u];
+        auto end = (u == g->num_nodes - 1) ? g->num_edges : g->incoming_starts[u + 1];
         
-        for (int i = start; i < end; i++) {
+        for (auto i = start; i < end; i++) {
             int v = g->incoming_edges[i];  // v 是 u 的父節點
 
             
@@ -263,7 +265,7 @@ void bottom_up_step(Graph g, VertexSet *frontier, VertexSet *new_frontier, int *
     // }
 }
 
-void bfs_bottom_up(Graph graph, solution *sol)
+template <typename G> void bfs_bottom_up_impl(G graph, solution *sol)
 {
     // For PP students:
     //
@@ -331,7 +333,7 @@ void bfs_bottom_up(Graph graph, solution *sol)
     vertex_set_destroy(&list2);
 }
 
-void bfs_hybrid(Graph graph, solution *sol)
+template <typename G> void bfs_hybrid_impl(G graph, solution *sol)
 {
     // For PP students:
     //
@@ -396,3 +398,34 @@ void bfs_hybrid(Graph graph, solution *sol)
     vertex_set_destroy(&list1);
     vertex_set_destroy(&list2);
 }
+
+// The same searches over graphs with 32-bit and 64-bit edge offsets.
+void bfs_top_down(Graph graph, solution *sol)
+{
+    bfs_top_down_impl(graph, sol);
+}
+
+void bfs_top_down(Graph64 graph, solution *sol)
+{
+    bfs_top_down_impl(graph, sol);
+}
+
+void bfs_bottom_up(Graph graph, solution *sol)
+{
+    bfs_bottom_up_impl(graph, sol);
+}
+
+void bfs_bottom_up(Graph64 graph, solution *sol)
+{
+    bfs_bottom_up_impl(graph, sol);
+}
+
+void bfs_hybrid(Graph graph, solution *sol)
+{
+    bfs_hybrid_impl(graph, sol);
+}
+
+void bfs_hybrid(Graph64 graph, solution *sol)
+{
+    bfs_hybrid_impl(graph, sol);
+}
@@ -23,4 +23,8 @@ void bfs_top_down(Graph graph, solution *sol);
 void bfs_bottom_up(Graph graph, solution *sol);
 void bfs_hybrid(Graph graph, solution *sol);
 
+void bfs_top_down(Graph64 graph, solution *sol);
+void bfs_bottom_up(Graph64 graph, solution *sol);
+void bfs_hybrid(Graph64 graph, solution *sol);
+
 #endif // BFS_H
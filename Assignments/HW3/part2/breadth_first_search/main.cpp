@@ -20,6 +20,77 @@ void reference_bfs_bottom_up(Graph graph, solution *sol);
 void reference_bfs_top_down(Graph graph, solution *sol);
 void reference_bfs_hybrid(Graph graph, solution *sol);
 
+// The reference searches only take graphs with 32-bit edge offsets, so
+// a graph64 is searched at one thread count and the bottom-up and
+// hybrid results are checked against top-down instead.
+static int run_graph64(const char *filename, int thread_count)
+{
+    Graph64 g = load_graph_binary64(filename);
+    printf("\n");
+    printf("Graph stats:\n");
+    printf("  Edges: %lld\n", g->num_edges);
+    printf("  Nodes: %d\n", g->num_nodes);
+
+    if (thread_count > 0)
+        omp_set_num_threads(thread_count);
+    thread_count = omp_get_max_threads();
+
+    printf("----------------------------------------------------------\n");
+    std::cout << "Running with " << thread_count << " threads" << '\n';
+    std::cout << "64-bit edge offsets: checking against top-down, no reference" << '\n';
+
+    solution top_sol = {.distances = new int[g->num_nodes]};
+    solution bottom_sol = {.distances = new int[g->num_nodes]};
+    solution hybrid_sol = {.distances = new int[g->num_nodes]};
+
+    double start = CycleTimer::current_seconds();
+    bfs_top_down(g, &top_sol);
+    double top_time = CycleTimer::current_seconds() - start;
+
+    start = CycleTimer::current_seconds();
+    bfs_bottom_up(g, &bottom_sol);
+    double bottom_time = CycleTimer::current_seconds() - start;
+
+    start = CycleTimer::current_seconds();
+    bfs_hybrid(g, &hybrid_sol);
+    double hybrid_time = CycleTimer::current_seconds() - start;
+
+    bool bus_check = true, hs_check = true;
+    for (int j = 0; j < g->num_nodes; j++)
+    {
+        if (bus_check && bottom_sol.distances[j] != top_sol.distances[j])
+        {
+            fprintf(stderr, "*** Results disagree at %d: %d, %d\n", j, bottom_sol.distances[j],
+                    top_sol.distances[j]);
+            bus_check = false;
+        }
+        if (hs_check && hybrid_sol.distances[j] != top_sol.distances[j])
+        {
+            fprintf(stderr, "*** Results disagree at %d: %d, %d\n", j, hybrid_sol.distances[j],
+                    top_sol.distances[j]);
+            hs_check = false;
+        }
+    }
+
+    delete[] top_sol.distances;
+    delete[] bottom_sol.distances;
+    delete[] hybrid_sol.distances;
+
+    if (!bus_check)
+        std::cout << "Bottom Up Search does not match Top Down" << '\n';
+    if (!hs_check)
+        std::cout << "Hybrid Search does not match Top Down" << '\n';
+    printf("----------------------------------------------------------\n");
+    std::cout << "Your Code: Timing Summary" << '\n';
+    printf("Threads   Top Down    Bottom Up       Hybrid\n");
+    printf("%4d:     %8.2f     %8.2f     %8.2f\n", thread_count, top_time, bottom_time,
+           hybrid_time);
+    printf("----------------------------------------------------------\n");
+
+    free_graph(g);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
 
@@ -57,6 +128,8 @@ int main(int argc, char **argv)
     printf("Loading graph...\n");
     if (USE_BINARY_GRAPH)
     {
+        if (graph_binary_has_64bit_offsets(graph_filename.c_str()))
+            return run_graph64(graph_filename.c_str(), thread_count);
         g = load_graph_binary(graph_filename.c_str());
     }
     else
@@ -1,16 +1,103 @@
+#include <algorithm>
 #include <array>
+#include <climits>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
-#include <sstream>
+#include <limits>
+#include <map>
+#include <omp.h>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
 
 #include "graph.h"
 
 #define GRAPH_HEADER_TOKEN ((int)0xDEADBEEF)
 
-void free_graph(Graph graph)
+// Version 2 binary layout: this header, then the outgoing and incoming
+// CSR arrays, each starting on a GRAPH_SECTION_ALIGN boundary so that
+// load_graph_binary can point the graph straight into a mapping of the
+// file.  A graph with 64-bit edge offsets has its own token and a 64-bit
+// num_edges.  Version 1 files hold the header token, the two counts and
+// the outgoing arrays back to back.
+#define GRAPH_HEADER_TOKEN_V2 ((int)0xDEADBEF2)
+#define GRAPH_HEADER_TOKEN_V2_64 ((int)0xDEADBE64)
+#define GRAPH_SECTION_ALIGN 4096
+
+// Edge offset type of a graph (int) or graph64 (long long).
+template <typename G> using offset_t = decltype(G::num_edges);
+
+template <typename Offset> struct graph_header_v2
+{
+    int token;
+    int num_nodes;
+    Offset num_edges;
+    int alignment;
+    // byte offsets of outgoing_starts, outgoing_edges, incoming_starts
+    // and incoming_edges
+    long long offsets[4];
+};
+
+template <typename Offset> constexpr int header_token_v2()
+{
+    return sizeof(Offset) == sizeof(int) ? GRAPH_HEADER_TOKEN_V2 : GRAPH_HEADER_TOKEN_V2_64;
+}
+
+// A whole file mapped into memory.
+struct mapped_file
+{
+    char *data;
+    size_t size;
+};
+
+// Binary graphs whose arrays point into a private mapping of their file
+// rather than into new[]ed memory; free_graph unmaps them.
+static std::map<const void *, mapped_file> mapped_graphs;
+
+// Map filename with the given protection.  The mapping is private, so
+// any writes stay in this process and the file is never modified.
+static mapped_file map_file(const char *filename, int prot)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not open: %s\n", filename);
+        exit(1);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        fprintf(stderr, "Could not read: %s\n", filename);
+        exit(1);
+    }
+
+    void *data = mmap(nullptr, info.st_size, prot, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map: %s\n", filename);
+        exit(1);
+    }
+    return {static_cast<char *>(data), (size_t)info.st_size};
+}
+
+template <typename G> static void free_any_graph(G *graph)
 {
+    auto mapping = mapped_graphs.find(graph);
+    if (mapping != mapped_graphs.end())
+    {
+        munmap(mapping->second.data, mapping->second.size);
+        mapped_graphs.erase(mapping);
+        delete graph;
+        return;
+    }
+
     delete[] graph->outgoing_starts;
     delete[] graph->outgoing_edges;
 
@@ -19,196 +106,345 @@ void free_graph(Graph graph)
     delete graph;
 }
 
-void build_start(graph *graph, const int *scratch)
+void free_graph(Graph graph)
 {
-    int num_nodes = graph->num_nodes;
-    graph->outgoing_starts = new int[num_nodes];
-    for (int i = 0; i < num_nodes; i++)
-    {
-        graph->outgoing_starts[i] = scratch[i];
-    }
+    free_any_graph(graph);
 }
 
-void build_edges(graph *graph, const int *scratch)
+void free_graph(Graph64 graph)
 {
-    int num_nodes = graph->num_nodes;
-    graph->outgoing_edges = new int[graph->num_edges];
-    for (int i = 0; i < graph->num_edges; i++)
+    free_any_graph(graph);
+}
+
+// Exclusive prefix sum of counts[0, n) into starts, which may be the
+// same array.  Every thread of the enclosing parallel region must call
+// it; partial needs one slot per thread plus one.
+template <typename Offset>
+static void exclusive_scan(const Offset *counts, Offset *starts, int n, Offset *partial)
+{
+    const int thread = omp_get_thread_num();
+    const int num_threads = omp_get_num_threads();
+    const int begin = (int)((long long)n * thread / num_threads);
+    const int end = (int)((long long)n * (thread + 1) / num_threads);
+
+    Offset sum = 0;
+    for (int i = begin; i < end; i++)
+        sum += counts[i];
+    partial[thread + 1] = sum;
+
+#pragma omp barrier
+#pragma omp single
+    {
+        partial[0] = 0;
+        for (int t = 0; t < num_threads; t++)
+            partial[t + 1] += partial[t];
+    }
+
+    sum = partial[thread];
+    for (int i = begin; i < end; i++)
     {
-        graph->outgoing_edges[i] = scratch[num_nodes + i];
+        Offset count = counts[i];
+        starts[i] = sum;
+        sum += count;
     }
+#pragma omp barrier
 }
 
-// Given an outgoing edge adjacency list representation for a directed
-// graph, build an incoming adjacency list representation
-void build_incoming_edges(graph *graph)
+// First vertex of thread's share when the vertices are split into
+// num_threads ranges with about the same number of outgoing edges.
+template <typename G> static int edge_balanced_start(const G *graph, int thread, int num_threads)
 {
+    if (thread == 0)
+        return 0;
+    if (thread == num_threads)
+        return graph->num_nodes;
+    long long target = (long long)graph->num_edges * thread / num_threads;
+    return (int)(std::lower_bound(graph->outgoing_starts,
+                                  graph->outgoing_starts + graph->num_nodes, target)
+                 - graph->outgoing_starts);
+}
 
-    // printf("Beginning build_incoming... (%d nodes)\n", graph->num_nodes);
+template <typename G> static inline offset_t<G> outgoing_stop(const G *graph, int v)
+{
+    return (v == graph->num_nodes - 1) ? graph->num_edges : graph->outgoing_starts[v + 1];
+}
 
-    int num_nodes = graph->num_nodes;
-    int *node_counts = new int[num_nodes];
-    int *node_scatter = new int[num_nodes];
+// Given an outgoing edge adjacency list representation for a directed
+// graph, build an incoming adjacency list representation.
+//
+// Each thread owns a contiguous range of source vertices.  When one
+// histogram of incoming counts per thread fits in about the memory of
+// the edge array, every thread counts into its own histogram and then
+// scatters to offsets derived from all of them, with no atomics.
+// Otherwise the threads share one histogram through atomics and sort
+// each vertex's sources afterwards.  Either way incoming_edges lists
+// each vertex's sources in increasing order, as the serial build did.
+template <typename G> static void build_incoming_edges(G *graph)
+{
+    using Offset = offset_t<G>;
+    const int num_nodes = graph->num_nodes;
+    const int max_threads = omp_get_max_threads();
+    const bool histograms
+        = (long long)max_threads * num_nodes <= (long long)graph->num_edges + (1 << 24);
 
-    graph->incoming_starts = new int[num_nodes];
-    graph->incoming_edges = new int[graph->num_edges];
+    graph->incoming_starts = new Offset[num_nodes];
+    graph->incoming_edges = new Vertex[graph->num_edges];
 
-    for (int i = 0; i < num_nodes; i++)
-        node_counts[i] = node_scatter[i] = 0;
+    Offset *partial = new Offset[max_threads + 1];
+    Offset *counts = new Offset[histograms ? (size_t)max_threads * num_nodes : (size_t)num_nodes];
 
-    int total_edges = 0;
-    // compute number of incoming edges per node
-    for (int i = 0; i < num_nodes; i++)
+#pragma omp parallel num_threads(max_threads)
     {
-        int start_edge = graph->outgoing_starts[i];
-        int end_edge
-            = (i == graph->num_nodes - 1) ? graph->num_edges : graph->outgoing_starts[i + 1];
-        for (int j = start_edge; j < end_edge; j++)
+        const int thread = omp_get_thread_num();
+        const int num_threads = omp_get_num_threads();
+        const int first = edge_balanced_start(graph, thread, num_threads);
+        const int last = edge_balanced_start(graph, thread + 1, num_threads);
+
+        if (histograms)
         {
-            int target_node = graph->outgoing_edges[j];
-            node_counts[target_node]++;
-            total_edges++;
-        }
-    }
-    // printf("Total edges: %d\n", total_edges);
-    // printf("Computed incoming edge counts.\n");
+            // compute number of incoming edges per node from my sources
+            Offset *mine = counts + (size_t)thread * num_nodes;
+            std::fill(mine, mine + num_nodes, 0);
+            for (int i = first; i < last; i++)
+            {
+                for (Offset j = graph->outgoing_starts[i]; j < outgoing_stop(graph, i); j++)
+                    mine[graph->outgoing_edges[j]]++;
+            }
+#pragma omp barrier
 
-    // build the starts array
-    graph->incoming_starts[0] = 0;
-    for (int i = 1; i < num_nodes; i++)
-    {
-        graph->incoming_starts[i] = graph->incoming_starts[i - 1] + node_counts[i - 1];
-        // printf("%d: %d ", i, graph->incoming_starts[i]);
-    }
-    // printf("\n");
-    // printf("Last edge=%d\n", graph->incoming_starts[num_nodes-1] + node_counts[num_nodes-1]);
+            // per node: each thread's offset among its sources, and the total
+#pragma omp for schedule(static)
+            for (int v = 0; v < num_nodes; v++)
+            {
+                Offset sum = 0;
+                for (int t = 0; t < num_threads; t++)
+                {
+                    Offset count = counts[(size_t)t * num_nodes + v];
+                    counts[(size_t)t * num_nodes + v] = sum;
+                    sum += count;
+                }
+                graph->incoming_starts[v] = sum;
+            }
 
-    // printf("Computed per-node incoming starts.\n");
+            exclusive_scan(graph->incoming_starts, graph->incoming_starts, num_nodes, partial);
 
-    // now perform the scatter
-    for (int i = 0; i < num_nodes; i++)
-    {
-        int start_edge = graph->outgoing_starts[i];
-        int end_edge
-            = (i == graph->num_nodes - 1) ? graph->num_edges : graph->outgoing_starts[i + 1];
-        for (int j = start_edge; j < end_edge; j++)
-        {
-            int target_node = graph->outgoing_edges[j];
-            graph->incoming_edges[graph->incoming_starts[target_node] + node_scatter[target_node]]
-                = i;
-            node_scatter[target_node]++;
+            // now perform the scatter
+            for (int i = first; i < last; i++)
+            {
+                for (Offset j = graph->outgoing_starts[i]; j < outgoing_stop(graph, i); j++)
+                {
+                    int target_node = graph->outgoing_edges[j];
+                    graph->incoming_edges[graph->incoming_starts[target_node]
+                                          + mine[target_node]++]
+                        = i;
+                }
+            }
         }
-    }
+        else
+        {
+#pragma omp for schedule(static)
+            for (int v = 0; v < num_nodes; v++)
+                counts[v] = 0;
+
+            for (int i = first; i < last; i++)
+            {
+                for (Offset j = graph->outgoing_starts[i]; j < outgoing_stop(graph, i); j++)
+                {
+#pragma omp atomic
+                    counts[graph->outgoing_edges[j]]++;
+                }
+            }
+#pragma omp barrier
+
+            exclusive_scan(counts, graph->incoming_starts, num_nodes, partial);
 
-    /*
-    // verify
-    printf("Verifying graph...\n");
-
-    for (int i=0; i<num_nodes; i++) {
-        int outgoing_starts = graph->outgoing_starts[i];
-        int end_node = (i == graph->num_nodes-1) ? graph->num_edges : graph->outgoing_starts[i+1];
-        for (int j=outgoing_starts; j<end_node; j++) {
-
-            bool verified = false;
-
-            // make sure that i is a neighbor of target_node
-            int target_node = graph->outgoing_edges[j];
-            int j_start_edge = graph->incoming_starts[target_node];
-            int j_end_edge = (target_node == graph->num_nodes-1)
-                    ? graph->num_edges :
-                    graph->incoming_starts[target_node+1];
-            for (int k=j_start_edge; k<j_end_edge; k++) {
-                if (graph->incoming_edges[k] == i) {
-                    verified = true;
-                    break;
+#pragma omp for schedule(static)
+            for (int v = 0; v < num_nodes; v++)
+                counts[v] = graph->incoming_starts[v];
+
+            for (int i = first; i < last; i++)
+            {
+                for (Offset j = graph->outgoing_starts[i]; j < outgoing_stop(graph, i); j++)
+                {
+                    Offset slot;
+#pragma omp atomic capture
+                    slot = counts[graph->outgoing_edges[j]]++;
+                    graph->incoming_edges[slot] = i;
                 }
             }
+#pragma omp barrier
 
-            if (!verified) {
-                fprintf(stderr,"Error: %d,%d did not verify\n", i, target_node);
+#pragma omp for schedule(dynamic, 1024)
+            for (int v = 0; v < num_nodes; v++)
+            {
+                Offset begin = graph->incoming_starts[v];
+                Offset end = (v == num_nodes - 1) ? graph->num_edges : graph->incoming_starts[v + 1];
+                std::sort(graph->incoming_edges + begin, graph->incoming_edges + end);
             }
         }
     }
 
-    printf("Done verifying\n");
-    */
+    delete[] counts;
+    delete[] partial;
+}
 
-    delete[] node_counts;
-    delete[] node_scatter;
+// The line starting at p, without its '\n'; *next is the line after it.
+static std::string next_line(const char *p, const char *end, const char **next)
+{
+    const char *stop = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (stop == nullptr)
+        stop = end;
+    *next = stop < end ? stop + 1 : end;
+    return std::string(p, stop);
 }
 
-void get_meta_data(std::ifstream &file, graph *graph)
+// Parse the "AdjacencyGraph" line and the vertex and edge counts, which
+// may be preceded by blank and '#' comment lines.  Returns the start of
+// the first line after the edge count.
+template <typename G> static const char *get_meta_data(const char *p, const char *end, G *graph)
 {
-    // going back to the beginning of the file
-    file.clear();
-    file.seekg(0, std::ios::beg);
-    std::string buffer;
-    std::getline(file, buffer);
-    if ((buffer.compare(std::string("AdjacencyGraph"))))
+    std::string buffer = next_line(p, end, &p);
+    if (buffer != "AdjacencyGraph")
     {
         std::cout << "Invalid input file" << buffer << '\n';
         exit(1);
     }
-    buffer.clear();
 
     do
     {
-        std::getline(file, buffer);
-    } while (buffer.empty() || buffer[0] == '#');
-
+        buffer = next_line(p, end, &p);
+    } while (p < end && (buffer.empty() || buffer[0] == '#'));
     graph->num_nodes = atoi(buffer.c_str());
-    buffer.clear();
 
     do
     {
-        std::getline(file, buffer);
-    } while (buffer.empty() || buffer[0] == '#');
+        buffer = next_line(p, end, &p);
+    } while (p < end && (buffer.empty() || buffer[0] == '#'));
+    long long num_edges = atoll(buffer.c_str());
+    if (num_edges > std::numeric_limits<offset_t<G>>::max())
+    {
+        fprintf(stderr, "Graph has %lld edges, too many for 32-bit edge offsets; load it with "
+                        "load_graph64.\n",
+                num_edges);
+        exit(1);
+    }
+    graph->num_edges = (offset_t<G>)num_edges;
 
-    graph->num_edges = atoi(buffer.c_str());
+    return p;
 }
 
-void read_graph_file(std::ifstream &file, int *scratch)
+// Count the integers in [p, end), which starts at the beginning of a
+// line, and with Store write value number first + k to outgoing_starts
+// or, past num_nodes, to outgoing_edges.  As with the stream parser
+// this replaces, lines starting with '#' are skipped and a token that
+// is not a number ends its line.
+template <bool Store, typename G>
+static long long parse_values(const char *p, const char *end, G *graph, long long first)
 {
-    std::string buffer;
-    int idx = 0;
-    while (!file.eof())
+    long long index = first;
+    bool line_start = true;
+
+    while (p < end)
     {
-        buffer.clear();
-        std::getline(file, buffer);
+        char c = *p;
+        if (c == '\n')
+        {
+            line_start = true;
+            p++;
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f')
+        {
+            line_start = false;
+            p++;
+            continue;
+        }
 
-        if (!buffer.empty() && buffer[0] == '#')
+        const char *digits = (c == '-' || c == '+') ? p + 1 : p;
+        if ((line_start && c == '#') || digits == end || *digits < '0' || *digits > '9')
+        {
+            const char *stop = static_cast<const char *>(memchr(p, '\n', end - p));
+            p = stop ? stop : end;
             continue;
+        }
+        line_start = false;
+
+        offset_t<G> value = 0;
+        for (p = digits; p < end && *p >= '0' && *p <= '9'; p++)
+            value = value * 10 + (*p - '0');
+        if (c == '-')
+            value = -value;
 
-        std::stringstream parse(buffer);
-        while (!parse.fail())
+        if (Store)
         {
-            int v;
-            parse >> v;
-            if (parse.fail())
+            if (index < graph->num_nodes)
+                graph->outgoing_starts[index] = value;
+            else
+                graph->outgoing_edges[index - graph->num_nodes] = (Vertex)value;
+        }
+        index++;
+    }
+    return index - first;
+}
+
+// Parse the body of a text graph in one chunk per thread, split at line
+// boundaries: count the values in each chunk, then let every chunk
+// store its values from the offset the counts give it.
+template <typename G> static void read_graph_file(const char *body, const char *end, G *graph)
+{
+    const int max_threads = omp_get_max_threads();
+    std::vector<long long> offsets(max_threads + 1, 0);
+    const long long expected = (long long)graph->num_nodes + graph->num_edges;
+
+#pragma omp parallel num_threads(max_threads)
+    {
+        const int thread = omp_get_thread_num();
+        const int num_threads = omp_get_num_threads();
+        auto chunk_start = [&](int t) {
+            if (t == 0)
+                return body;
+            if (t == num_threads)
+                return end;
+            const char *p = body + (end - body) * t / num_threads;
+            while (p < end && p[-1] != '\n')
+                p++;
+            return p;
+        };
+        const char *begin = chunk_start(thread);
+        const char *stop = chunk_start(thread + 1);
+
+        offsets[thread + 1] = parse_values<false>(begin, stop, graph, 0);
+#pragma omp barrier
+#pragma omp single
+        {
+            for (int t = 0; t < num_threads; t++)
+                offsets[t + 1] += offsets[t];
+            if (offsets[num_threads] != expected)
             {
-                break;
+                fprintf(stderr, "Graph file holds %lld values, expected %lld.\n",
+                        offsets[num_threads], expected);
+                exit(1);
             }
-            scratch[idx] = v;
-            idx++;
         }
+        parse_values<true>(begin, stop, graph, offsets[thread]);
     }
 }
 
-void print_graph(const graph *graph)
+template <typename G> static void print_any_graph(const G *graph)
 {
 
     printf("Graph pretty print:\n");
     printf("num_nodes=%d\n", graph->num_nodes);
-    printf("num_edges=%d\n", graph->num_edges);
+    printf("num_edges=%lld\n", (long long)graph->num_edges);
 
     for (int i = 0; i < graph->num_nodes; i++)
     {
 
-        int start_edge = graph->outgoing_starts[i];
-        int end_edge
+        offset_t<G> start_edge = graph->outgoing_starts[i];
+        offset_t<G> end_edge
             = (i == graph->num_nodes - 1) ? graph->num_edges : graph->outgoing_starts[i + 1];
-        printf("node %02d: out=%d: ", i, end_edge - start_edge);
-        for (int j = start_edge; j < end_edge; j++)
+        printf("node %02d: out=%lld: ", i, (long long)(end_edge - start_edge));
+        for (offset_t<G> j = start_edge; j < end_edge; j++)
         {
             int target = graph->outgoing_edges[j];
             printf("%d ", target);
@@ -217,8 +453,8 @@ void print_graph(const graph *graph)
 
         start_edge = graph->incoming_starts[i];
         end_edge = (i == graph->num_nodes - 1) ? graph->num_edges : graph->incoming_starts[i + 1];
-        printf("         in=%d: ", end_edge - start_edge);
-        for (int j = start_edge; j < end_edge; j++)
+        printf("         in=%lld: ", (long long)(end_edge - start_edge));
+        for (offset_t<G> j = start_edge; j < end_edge; j++)
         {
             int target = graph->incoming_edges[j];
             printf("%d ", target);
@@ -227,21 +463,29 @@ void print_graph(const graph *graph)
     }
 }
 
-Graph load_graph(const char *filename)
+void print_graph(const graph *graph)
 {
-    graph *graph = new struct graph;
+    print_any_graph(graph);
+}
 
-    // open the file
-    std::ifstream graph_file;
-    graph_file.open(filename);
-    get_meta_data(graph_file, graph);
+void print_graph(const graph64 *graph)
+{
+    print_any_graph(graph);
+}
 
-    int *scratch = new int[graph->num_nodes + graph->num_edges];
-    read_graph_file(graph_file, scratch);
+template <typename G> static G *load_text_graph(const char *filename)
+{
+    G *graph = new G;
+
+    mapped_file file = map_file(filename, PROT_READ);
+    madvise(file.data, file.size, MADV_SEQUENTIAL);
+    const char *end = file.data + file.size;
+    const char *body = get_meta_data(file.data, end, graph);
 
-    build_start(graph, scratch);
-    build_edges(graph, scratch);
-    delete[] scratch;
+    graph->outgoing_starts = new offset_t<G>[graph->num_nodes];
+    graph->outgoing_edges = new Vertex[graph->num_edges];
+    read_graph_file(body, end, graph);
+    munmap(file.data, file.size);
 
     build_incoming_edges(graph);
 
@@ -250,61 +494,237 @@ Graph load_graph(const char *filename)
     return graph;
 }
 
-Graph load_graph_binary(const char *filename)
+Graph load_graph(const char *filename)
 {
-    graph *graph = new struct graph;
+    return load_text_graph<graph>(filename);
+}
 
-    FILE *input = fopen(filename, "rb");
+Graph64 load_graph64(const char *filename)
+{
+    return load_text_graph<graph64>(filename);
+}
 
-    if (!input)
+// Point graph into a version 2 file mapped at file.data, whose header
+// token has already been checked to match G.
+template <typename G> static void attach_graph_v2(G *graph, const mapped_file &file)
+{
+    graph_header_v2<offset_t<G>> header;
+    if (file.size < sizeof(header))
     {
-        fprintf(stderr, "Could not open: %s\n", filename);
+        fprintf(stderr, "Error reading header.\n");
         exit(1);
     }
+    memcpy(&header, file.data, sizeof(header));
 
+    graph->num_nodes = header.num_nodes;
+    graph->num_edges = header.num_edges;
+
+    // start of section i, holding count elements of the given size
+    auto section = [&](int i, long long count, size_t size) {
+        long long offset = header.offsets[i];
+        if (count < 0 || offset < (long long)sizeof(header) || offset % size != 0
+            || offset + count * (long long)size > (long long)file.size)
+        {
+            fprintf(stderr, "Invalid graph file layout. File may be corrupt.\n");
+            exit(1);
+        }
+        return file.data + offset;
+    };
+    const size_t offset_size = sizeof(offset_t<G>);
+    graph->outgoing_starts
+        = reinterpret_cast<offset_t<G> *>(section(0, header.num_nodes, offset_size));
+    graph->outgoing_edges
+        = reinterpret_cast<Vertex *>(section(1, header.num_edges, sizeof(Vertex)));
+    graph->incoming_starts
+        = reinterpret_cast<offset_t<G> *>(section(2, header.num_nodes, offset_size));
+    graph->incoming_edges
+        = reinterpret_cast<Vertex *>(section(3, header.num_edges, sizeof(Vertex)));
+}
+
+// Copy the outgoing arrays of a version 1 file mapped at file.data.
+static void read_graph_v1(graph *graph, const mapped_file &file)
+{
     constexpr int header_size = 3;
     std::array<int, header_size> header;
 
-    if (fread(header.data(), sizeof(int), header_size, input) != header_size)
+    if (file.size < sizeof(header))
     {
         fprintf(stderr, "Error reading header.\n");
         exit(1);
     }
-
-    if (header[0] != GRAPH_HEADER_TOKEN)
-    {
-        fprintf(stderr, "Invalid graph file header. File may be corrupt.\n");
-        exit(1);
-    }
+    memcpy(header.data(), file.data, sizeof(header));
 
     graph->num_nodes = header[1];
     graph->num_edges = header[2];
 
-    graph->outgoing_starts = new int[graph->num_nodes];
-    graph->outgoing_edges = new int[graph->num_edges];
+    const size_t starts_bytes = sizeof(int) * (size_t)graph->num_nodes;
+    const size_t edges_bytes = sizeof(int) * (size_t)graph->num_edges;
 
-    if (fread(graph->outgoing_starts, sizeof(int), graph->num_nodes, input)
-        != (size_t)graph->num_nodes)
+    if (file.size < sizeof(header) + starts_bytes)
     {
         fprintf(stderr, "Error reading nodes.\n");
         exit(1);
     }
 
-    if (fread(graph->outgoing_edges, sizeof(int), graph->num_edges, input)
-        != (size_t)graph->num_edges)
+    if (file.size < sizeof(header) + starts_bytes + edges_bytes)
     {
         fprintf(stderr, "Error reading edges.\n");
         exit(1);
     }
 
-    fclose(input);
+    graph->outgoing_starts = new int[graph->num_nodes];
+    graph->outgoing_edges = new int[graph->num_edges];
+    memcpy(graph->outgoing_starts, file.data + sizeof(header), starts_bytes);
+    memcpy(graph->outgoing_edges, file.data + sizeof(header) + starts_bytes, edges_bytes);
 
     build_incoming_edges(graph);
+}
+
+// Version 2 files are mapped copy-on-write and used in place: nothing is
+// read until it is touched, and processes loading the same graph share
+// its pages in the page cache.  Version 1 files are copied out and get
+// their incoming edges built as before.
+Graph load_graph_binary(const char *filename)
+{
+    graph *graph = new struct graph;
+
+    mapped_file file = map_file(filename, PROT_READ | PROT_WRITE);
+
+    int token = 0;
+    if (file.size >= sizeof(token))
+        memcpy(&token, file.data, sizeof(token));
+
+    if (token == GRAPH_HEADER_TOKEN_V2)
+    {
+        attach_graph_v2(graph, file);
+        mapped_graphs[graph] = file;
+    }
+    else if (token == GRAPH_HEADER_TOKEN)
+    {
+        read_graph_v1(graph, file);
+        munmap(file.data, file.size);
+    }
+    else if (token == GRAPH_HEADER_TOKEN_V2_64)
+    {
+        fprintf(stderr, "Graph has 64-bit edge offsets; load it with load_graph_binary64.\n");
+        exit(1);
+    }
+    else
+    {
+        fprintf(stderr, "Invalid graph file header. File may be corrupt.\n");
+        exit(1);
+    }
+
     // print_graph(graph);
     return graph;
 }
 
-void store_graph_binary(const char *filename, Graph graph)
+// A graph64 copy of a graph, with widened offsets.
+static graph64 *widen_graph(const graph *narrow)
+{
+    graph64 *graph = new graph64;
+    graph->num_nodes = narrow->num_nodes;
+    graph->num_edges = narrow->num_edges;
+
+    graph->outgoing_starts = new long long[graph->num_nodes];
+    graph->outgoing_edges = new Vertex[graph->num_edges];
+    graph->incoming_starts = new long long[graph->num_nodes];
+    graph->incoming_edges = new Vertex[graph->num_edges];
+
+    std::copy(narrow->outgoing_starts, narrow->outgoing_starts + graph->num_nodes,
+              graph->outgoing_starts);
+    std::copy(narrow->outgoing_edges, narrow->outgoing_edges + graph->num_edges,
+              graph->outgoing_edges);
+    std::copy(narrow->incoming_starts, narrow->incoming_starts + graph->num_nodes,
+              graph->incoming_starts);
+    std::copy(narrow->incoming_edges, narrow->incoming_edges + graph->num_edges,
+              graph->incoming_edges);
+    return graph;
+}
+
+// Files with 64-bit offsets are mapped in place like load_graph_binary
+// does; others are loaded as a graph and widened.
+Graph64 load_graph_binary64(const char *filename)
+{
+    if (!graph_binary_has_64bit_offsets(filename))
+    {
+        graph *narrow = load_graph_binary(filename);
+        graph64 *graph = widen_graph(narrow);
+        free_graph(narrow);
+        return graph;
+    }
+
+    graph64 *graph = new graph64;
+    mapped_file file = map_file(filename, PROT_READ | PROT_WRITE);
+    attach_graph_v2(graph, file);
+    mapped_graphs[graph] = file;
+    return graph;
+}
+
+bool graph_binary_has_64bit_offsets(const char *filename)
+{
+    FILE *input = fopen(filename, "rb");
+    if (!input)
+        return false;
+
+    int token = 0;
+    bool wide = fread(&token, sizeof(token), 1, input) == 1 && token == GRAPH_HEADER_TOKEN_V2_64;
+    fclose(input);
+    return wide;
+}
+
+// Pad output with zeros up to offset, then write count elements of data
+// as FileType.
+template <typename FileType, typename T>
+static void write_section(FILE *output, long long offset, const T *data, long long count,
+                          const char *what)
+{
+    static const char zeros[GRAPH_SECTION_ALIGN] = {};
+
+    long long position = ftell(output);
+    while (position < offset)
+    {
+        size_t pad = (size_t)std::min<long long>(offset - position, sizeof(zeros));
+        if (fwrite(zeros, 1, pad, output) != pad)
+        {
+            fprintf(stderr, "Error writing %s.\n", what);
+            exit(1);
+        }
+        position += pad;
+    }
+
+    if (std::is_same<FileType, T>::value)
+    {
+        if (fwrite(data, sizeof(T), count, output) != (size_t)count)
+        {
+            fprintf(stderr, "Error writing %s.\n", what);
+            exit(1);
+        }
+        return;
+    }
+
+    constexpr long long chunk = 4096;
+    FileType buffer[chunk];
+    for (long long done = 0; done < count; done += chunk)
+    {
+        long long n = std::min(chunk, count - done);
+        std::copy(data + done, data + done + n, buffer);
+        if (fwrite(buffer, sizeof(FileType), n, output) != (size_t)n)
+        {
+            fprintf(stderr, "Error writing %s.\n", what);
+            exit(1);
+        }
+    }
+}
+
+static long long align_section(long long offset)
+{
+    return (offset + GRAPH_SECTION_ALIGN - 1) / GRAPH_SECTION_ALIGN * GRAPH_SECTION_ALIGN;
+}
+
+// Write graph with edge offsets of type Offset in the file.
+template <typename Offset, typename G>
+static void store_graph_binary_as(const char *filename, const G *graph)
 {
 
     FILE *output = fopen(filename, "wb");
@@ -315,31 +735,50 @@ void store_graph_binary(const char *filename, Graph graph)
         exit(1);
     }
 
-    std::array<int, 3> header = {
-        GRAPH_HEADER_TOKEN,
-        graph->num_nodes,
-        graph->num_edges,
-    };
+    const long long starts_bytes = sizeof(Offset) * (long long)graph->num_nodes;
+    const long long edges_bytes = sizeof(Vertex) * (long long)graph->num_edges;
+
+    graph_header_v2<Offset> header = {};
+    header.token = header_token_v2<Offset>();
+    header.num_nodes = graph->num_nodes;
+    header.num_edges = (Offset)graph->num_edges;
+    header.alignment = GRAPH_SECTION_ALIGN;
+    header.offsets[0] = align_section(sizeof(header));
+    header.offsets[1] = align_section(header.offsets[0] + starts_bytes);
+    header.offsets[2] = align_section(header.offsets[1] + edges_bytes);
+    header.offsets[3] = align_section(header.offsets[2] + starts_bytes);
 
-    if (fwrite(header.data(), sizeof(int), header.size(), output) != header.size())
+    if (fwrite(&header, sizeof(header), 1, output) != 1)
     {
         fprintf(stderr, "Error writing header.\n");
         exit(1);
     }
 
-    if (fwrite(graph->outgoing_starts, sizeof(int), graph->num_nodes, output)
-        != (size_t)graph->num_nodes)
-    {
-        fprintf(stderr, "Error writing nodes.\n");
-        exit(1);
-    }
+    write_section<Offset>(output, header.offsets[0], graph->outgoing_starts, graph->num_nodes,
+                          "nodes");
+    write_section<Vertex>(output, header.offsets[1], graph->outgoing_edges, graph->num_edges,
+                          "edges");
+    write_section<Offset>(output, header.offsets[2], graph->incoming_starts, graph->num_nodes,
+                          "incoming nodes");
+    write_section<Vertex>(output, header.offsets[3], graph->incoming_edges, graph->num_edges,
+                          "incoming edges");
 
-    if (fwrite(graph->outgoing_edges, sizeof(int), graph->num_edges, output)
-        != (size_t)graph->num_edges)
+    if (fclose(output) != 0)
     {
-        fprintf(stderr, "Error writing edges.\n");
+        fprintf(stderr, "Error writing %s\n", filename);
         exit(1);
     }
+}
+
+void store_graph_binary(const char *filename, Graph graph)
+{
+    store_graph_binary_as<int>(filename, graph);
+}
 
-    fclose(output);
+void store_graph_binary(const char *filename, Graph64 graph)
+{
+    if (graph->num_edges <= INT_MAX)
+        store_graph_binary_as<int>(filename, graph);
+    else
+        store_graph_binary_as<long long>(filename, graph);
 }
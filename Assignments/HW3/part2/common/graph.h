@@ -23,6 +23,23 @@ struct graph // NOLINT(readability-identifier-naming): The name is used by share
 
 using Graph = graph *;
 
+// The same representation with 64-bit edge offsets, for graphs with
+// 2^31 or more edges.  Vertex ids stay 32-bit, so outgoing_edges and
+// incoming_edges take no more memory than in a graph.
+struct graph64
+{
+    long long num_edges;
+    int num_nodes;
+
+    long long *outgoing_starts;
+    Vertex *outgoing_edges;
+
+    long long *incoming_starts;
+    Vertex *incoming_edges;
+};
+
+using Graph64 = graph64 *;
+
 /* Getters */
 static inline int num_nodes(Graph);
 static inline int num_edges(Graph);
@@ -35,15 +52,37 @@ static inline const Vertex *incoming_begin(Graph, Vertex);
 static inline const Vertex *incoming_end(Graph, Vertex);
 static inline int incoming_size(Graph, Vertex);
 
+static inline int num_nodes(Graph64);
+static inline long long num_edges(Graph64);
+
+static inline const Vertex *outgoing_begin(Graph64, Vertex);
+static inline const Vertex *outgoing_end(Graph64, Vertex);
+static inline long long outgoing_size(Graph64, Vertex);
+
+static inline const Vertex *incoming_begin(Graph64, Vertex);
+static inline const Vertex *incoming_end(Graph64, Vertex);
+static inline long long incoming_size(Graph64, Vertex);
+
 /* IO */
 Graph load_graph(const char *filename);
 Graph load_graph_binary(const char *filename);
 void store_graph_binary(const char *filename, Graph);
 
+// load_graph and load_graph_binary refuse graphs that need 64-bit edge
+// offsets; these load any graph.  store_graph_binary writes a graph64
+// with 32-bit offsets when its edge count allows, so the 32-bit
+// programs can still load it.
+Graph64 load_graph64(const char *filename);
+Graph64 load_graph_binary64(const char *filename);
+void store_graph_binary(const char *filename, Graph64);
+bool graph_binary_has_64bit_offsets(const char *filename);
+
 void print_graph(const graph *);
+void print_graph(const graph64 *);
 
 /* Deallocation */
 void free_graph(Graph);
+void free_graph(Graph64);
 
 /* Included here to enable inlining. Don't look. */
 #include "graph_internal.h"
@@ -68,4 +68,68 @@ static inline int incoming_size(const Graph g, Vertex v)
     return g->incoming_starts[v + 1] - g->incoming_starts[v];
 }
 
+static inline int num_nodes(const Graph64 graph)
+{
+    REQUIRES(graph != NULL);
+    return graph->num_nodes;
+}
+
+static inline long long num_edges(const Graph64 graph)
+{
+    REQUIRES(graph != NULL);
+    return graph->num_edges;
+}
+
+static inline const Vertex *outgoing_begin(const Graph64 g, Vertex v)
+{
+    REQUIRES(g != NULL);
+    REQUIRES(0 <= v && v < num_nodes(g));
+    return g->outgoing_edges + g->outgoing_starts[v];
+}
+
+static inline const Vertex *outgoing_end(const Graph64 g, Vertex v)
+{
+    REQUIRES(g != NULL);
+    REQUIRES(0 <= v && v < num_nodes(g));
+    long long offset = (v == g->num_nodes - 1) ? g->num_edges : g->outgoing_starts[v + 1];
+    return g->outgoing_edges + offset;
+}
+
+static inline long long outgoing_size(const Graph64 g, Vertex v)
+{
+    REQUIRES(g != NULL);
+    REQUIRES(0 <= v && v < num_nodes(g));
+    if (v == g->num_nodes - 1)
+    {
+        return g->num_edges - g->outgoing_starts[v];
+    }
+    return g->outgoing_starts[v + 1] - g->outgoing_starts[v];
+}
+
+static inline const Vertex *incoming_begin(const Graph64 g, Vertex v)
+{
+    REQUIRES(g != NULL);
+    REQUIRES(0 <= v && v < num_nodes(g));
+    return g->incoming_edges + g->incoming_starts[v];
+}
+
+static inline const Vertex *incoming_end(const Graph64 g, Vertex v)
+{
+    REQUIRES(g != NULL);
+    REQUIRES(0 <= v && v < num_nodes(g));
+    long long offset = (v == g->num_nodes - 1) ? g->num_edges : g->incoming_starts[v + 1];
+    return g->incoming_edges + offset;
+}
+
+static inline long long incoming_size(const Graph64 g, Vertex v)
+{
+    REQUIRES(g != NULL);
+    REQUIRES(0 <= v && v < num_nodes(g));
+    if (v == g->num_nodes - 1)
+    {
+        return g->num_edges - g->incoming_starts[v];
+    }
+    return g->incoming_starts[v + 1] - g->incoming_starts[v];
+}
+
 #endif // GRAPH_INTERNAL_H
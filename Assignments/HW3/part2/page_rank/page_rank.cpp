@@ -14,7 +14,8 @@
 // damping:     page-rank algorithm's damping parameter
 // convergence: page-rank algorithm's convergence threshold
 //
-void page_rank(Graph g, double *solution, double damping, double convergence)
+template <typename G>
+static void page_rank_impl(G g, double *solution, double damping, double convergence)
 {
 
     // initialize vertex weights to uniform probability. Double
@@ -112,3 +113,13 @@ void page_rank(Graph g, double *solution, double damping, double convergence)
 
      */
 }
+
+void page_rank(Graph g, double *solution, double damping, double convergence)
+{
+    page_rank_impl(g, solution, damping, convergence);
+}
+
+void page_rank(Graph64 g, double *solution, double damping, double convergence)
+{
+    page_rank_impl(g, solution, damping, convergence);
+}
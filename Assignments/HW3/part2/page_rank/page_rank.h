@@ -4,5 +4,6 @@
 #include "common/graph.h"
 
 void page_rank(Graph g, double *solution, double damping, double convergence);
+void page_rank(Graph64 g, double *solution, double damping, double convergence);
 
 #endif /* PAGE_RANK_H */
@@ -9,6 +9,7 @@
 #include "../common/graph.h"
 
 const std::string CMD_TEXT2BIN = "text2bin";
+const std::string CMD_BIN2BIN = "bin2bin";
 const std::string CMD_INFO = "info";
 const std::string CMD_PRINT = "print";
 const std::string CMD_NOOUTEDGES = "noout";
@@ -22,6 +23,7 @@ void print_help(const char *binary_name)
     std::cerr << "\n";
     std::cerr << "Valid cmds are:\n\n"
               << CMD_TEXT2BIN << ": text file to binary file conversion\n"
+              << CMD_BIN2BIN << ": rewrite a binary file in the current (mmap-able) format\n"
               << CMD_INFO << ": print graph metadata\n"
               << CMD_PRINT << ": print graph topology (careful with big graphs)\n"
               << CMD_NOOUTEDGES << ": detect vertices with no outgoing edges\n"
@@ -54,9 +56,31 @@ int main(int argc, char **argv)
         std::string input_filename = std::string(argv[2]);
         std::string output_filename = std::string(argv[3]);
 
-        Graph g;
+        Graph64 g;
         std::cout << "Loading graph: " << input_filename << "\n";
-        g = load_graph(input_filename.c_str());
+        g = load_graph64(input_filename.c_str());
+        std::cout << "Done loading.\n";
+        store_graph_binary(output_filename.c_str(), g);
+        free_graph(g);
+    }
+    else if (cmd == CMD_BIN2BIN)
+    {
+
+        if (argc < 4)
+        {
+            std::cerr << "Usage: " << argv[0] << " " << cmd << " binfilename newbinfilename\n";
+            std::cerr << "Rewrites a binary graph, in either the old or the current format, in "
+                         "the current format, which also stores incoming edges and is loaded "
+                         "by mapping the file\n";
+            exit(1);
+        }
+
+        std::string input_filename = std::string(argv[2]);
+        std::string output_filename = std::string(argv[3]);
+
+        Graph64 g;
+        std::cout << "Loading graph: " << input_filename << "\n";
+        g = load_graph_binary64(input_filename.c_str());
         std::cout << "Done loading.\n";
         store_graph_binary(output_filename.c_str(), g);
         free_graph(g);
@@ -72,9 +96,9 @@ int main(int argc, char **argv)
 
         std::string input_filename = std::string(argv[2]);
 
-        Graph g;
+        Graph64 g;
         std::cout << "Loading graph: " << input_filename << "\n";
-        g = load_graph_binary(input_filename.c_str());
+        g = load_graph_binary64(input_filename.c_str());
         std::cout << "Done loading.\n";
 
         std::cout << "Num vertices: " << num_nodes(g) << "\n";
@@ -94,9 +118,9 @@ int main(int argc, char **argv)
 
         std::string input_filename = std::string(argv[2]);
 
-        Graph g;
+        Graph64 g;
         std::cout << "Loading graph: " << input_filename << "\n";
-        g = load_graph_binary(input_filename.c_str());
+        g = load_graph_binary64(input_filename.c_str());
         std::cout << "Done loading.\n";
         print_graph(g);
         free_graph(g);
@@ -113,9 +137,9 @@ int main(int argc, char **argv)
 
         std::string input_filename = std::string(argv[2]);
 
-        Graph g;
+        Graph64 g;
         std::cout << "Loading graph: " << input_filename << "\n";
-        g = load_graph_binary(input_filename.c_str());
+        g = load_graph_binary64(input_filename.c_str());
         std::cout << "Done loading.\n";
 
         std::vector<Vertex> zero_outgoing;
@@ -151,9 +175,9 @@ int main(int argc, char **argv)
 
         std::string input_filename = std::string(argv[2]);
 
-        Graph g;
+        Graph64 g;
         std::cout << "Loading graph: " << input_filename << "\n";
-        g = load_graph_binary(input_filename.c_str());
+        g = load_graph_binary64(input_filename.c_str());
         std::cout << "Done loading.\n";
 
         std::vector<Vertex> zero_incoming;
@@ -189,24 +213,24 @@ int main(int argc, char **argv)
 
         std::string input_filename = std::string(argv[2]);
 
-        Graph g;
+        Graph64 g;
         std::cout << "Loading graph: " << input_filename << "\n";
-        g = load_graph_binary(input_filename.c_str());
+        g = load_graph_binary64(input_filename.c_str());
         std::cout << "Done loading. Now analyzing graph...\n";
 
-        unsigned int total_incoming = 0;
-        unsigned int total_outgoing = 0;
-        unsigned int min_outgoing = INT_MAX;
-        unsigned int max_outgoing = 0;
-        unsigned int min_incoming = INT_MAX;
-        unsigned int max_incoming = 0;
+        long long total_incoming = 0;
+        long long total_outgoing = 0;
+        long long min_outgoing = LLONG_MAX;
+        long long max_outgoing = 0;
+        long long min_incoming = LLONG_MAX;
+        long long max_incoming = 0;
         bool is_symmetric = true;
 
         for (int i = 0; i < num_nodes(g); i++)
         {
 
-            unsigned int num_incoming = incoming_size(g, i);
-            unsigned int num_outgoing = outgoing_size(g, i);
+            long long num_incoming = incoming_size(g, i);
+            long long num_outgoing = outgoing_size(g, i);
 
             min_outgoing = std::min(min_outgoing, num_outgoing);
             max_outgoing = std::max(max_outgoing, num_outgoing);
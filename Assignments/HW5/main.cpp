@@ -27,6 +27,9 @@ extern void mandelbrot_thread_ref(
 extern void
 write_ppm_image(int *data, int width, int height, const char *filename, int max_iterations);
 
+extern void
+write_png_image(int *data, int width, int height, const char *filename, int max_iterations);
+
 void scale_and_shift(
     float &x0, float &x1, float &y0, float &y1, float scale, float shift_x, float shift_y)
 {
@@ -48,6 +51,7 @@ void usage(const char *progname)
     printf("  -i  --iter <INT>       Use specified interation (>=256) (Default = 256)\n");
     printf("  -v  --view <INT>       Use specified view settings (1 or 2) (Default = 1)\n");
     printf("  -g  --gpu-only <INT>   Only run GPU or not (1 or 0) (Default = 0)\n");
+    printf("  -o  --output <FORMAT>  Image output format (ppm or png) (Default = ppm)\n");
     printf("  -?  --help             This message\n");
 }
 
@@ -79,6 +83,7 @@ int main(int argc, char **argv)
     const unsigned int height = 1200;
     int max_iterations = 256;
     bool is_gpu_only = false;
+    bool is_png = false;
 
     float x0 = -2;
     float x1 = 1;
@@ -91,10 +96,11 @@ int main(int argc, char **argv)
     static struct option long_options[] = {{"iter", 1, nullptr, 'i'},
                                            {"view", 1, nullptr, 'v'},
                                            {"gpu-only", 1, nullptr, 'g'},
+                                           {"output", 1, nullptr, 'o'},
                                            {"help", 0, nullptr, '?'},
                                            {nullptr, 0, nullptr, 0}};
 
-    while ((opt = getopt_long(argc, argv, "i:v:g:?", long_options, nullptr)) != EOF)
+    while ((opt = getopt_long(argc, argv, "i:v:g:o:?", long_options, nullptr)) != EOF)
     {
 
         switch (opt)
@@ -143,6 +149,19 @@ int main(int argc, char **argv)
                 }
                 break;
             }
+            case 'o':
+            {
+                if (strcmp(optarg, "ppm") == 0 || strcmp(optarg, "png") == 0)
+                {
+                    is_png = strcmp(optarg, "png") == 0;
+                }
+                else
+                {
+                    fprintf(stderr, "Invalid output format. Only allow ppm or png.\n");
+                    return 1;
+                }
+                break;
+            }
             case '?':
             default:
                 usage(argv[0]);
@@ -196,7 +215,10 @@ int main(int argc, char **argv)
     min_ref /= 4;
 
     printf("[mandelbrot reference]:\t\t[%.3f] ms\n", min_ref * 1000);
-    write_ppm_image(output_test, width, height, "mandelbrot-ref.ppm", max_iterations);
+    if (is_png)
+        write_png_image(output_test, width, height, "mandelbrot-ref.png", max_iterations);
+    else
+        write_ppm_image(output_test, width, height, "mandelbrot-ref.ppm", max_iterations);
 
     //
     // Run the threaded version
@@ -220,7 +242,10 @@ int main(int argc, char **argv)
     min_thread /= 4;
 
     printf("[mandelbrot thread]:\t\t[%.3f] ms\n", min_thread * 1000);
-    write_ppm_image(output_thread, width, height, "mandelbrot-thread.ppm", max_iterations);
+    if (is_png)
+        write_png_image(output_thread, width, height, "mandelbrot-thread.png", max_iterations);
+    else
+        write_ppm_image(output_thread, width, height, "mandelbrot-thread.ppm", max_iterations);
 
     if (!verify_result(output_test, output_thread, width, height))
     {